@@ -0,0 +1,153 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef BATCH_STATS_H
+#define BATCH_STATS_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "../env/gridworld.h"
+#include "../utils/thread_pool.h"
+
+// Sufficient statistics of all timesteps that share one (state, action) pair
+struct PairStats {
+    double count = 0.0;          // number of timesteps
+    double sum_weight = 0.0;     // sum of returns / advantages
+    double sum_pos_weight = 0.0; // sum of the positive part of the weights (PPO clipping needs the sign split)
+    double old_count = 0.0;      // timesteps with a usable behaviour probability (> 1e-8)
+    double sum_old_prob = 0.0;   // sum of behaviour probabilities over those timesteps
+    double sum_old_plogp = 0.0;  // sum of p * log(p) of the behaviour probabilities
+
+    double sum_neg_weight() const { return sum_weight - sum_pos_weight; }
+    double mean_old_prob() const { return old_count > 0.0 ? sum_old_prob / old_count : 0.0; }
+
+    void merge(const PairStats& o) {
+        count += o.count;
+        sum_weight += o.sum_weight;
+        sum_pos_weight += o.sum_pos_weight;
+        old_count += o.old_count;
+        sum_old_prob += o.sum_old_prob;
+        sum_old_plogp += o.sum_old_plogp;
+    }
+};
+
+// Compressed view of a batch of trajectories: (state, action) -> PairStats.
+// The tabular softmax gradient, diagonal Fisher, sampled KL and PPO surrogate are all
+// linear in these sums, so updates cost O(distinct pairs) instead of O(timesteps).
+// Entries assume the whole batch was collected under one policy snapshot, so every
+// timestep of a pair shares the same behaviour probability.
+class BatchStats {
+private:
+    std::vector<PairStats> table;  // dense [state][action], only touched rows are non-zero
+    std::vector<uint8_t> touched;
+    std::vector<int> touched_states;  // distinct states in first-visit order
+    double total = 0.0;
+
+public:
+    BatchStats() : table(static_cast<size_t>(NUM_STATES) * ACTIONS), touched(NUM_STATES, 0) {}
+
+    void clear() {
+        for (int s : touched_states) {
+            for (int a = 0; a < ACTIONS; ++a) {
+                table[static_cast<size_t>(s) * ACTIONS + a] = PairStats{};
+            }
+            touched[s] = 0;
+        }
+        touched_states.clear();
+        total = 0.0;
+    }
+
+    // Record n identical timesteps of (s, action) with per-step weight and behaviour probability
+    void add(int s, int action, double weight, double old_prob = 0.0, double n = 1.0) {
+        add_sums(s, action, n, n * weight, weight > 0.0 ? n * weight : 0.0, old_prob);
+    }
+
+    // Record n timesteps of (s, action) sharing one behaviour probability whose weights
+    // differ, given the sum of their weights and of the positive ones (a run-length run)
+    void add_sums(int s, int action, double n, double sum_weight, double sum_pos_weight, double old_prob = 0.0) {
+        if (!touched[s]) {
+            touched[s] = 1;
+            touched_states.push_back(s);
+        }
+        PairStats& e = table[static_cast<size_t>(s) * ACTIONS + action];
+        e.count += n;
+        e.sum_weight += sum_weight;
+        e.sum_pos_weight += sum_pos_weight;
+        if (old_prob > 1e-8) {
+            e.old_count += n;
+            e.sum_old_prob += n * old_prob;
+            e.sum_old_plogp += n * old_prob * std::log(old_prob);
+        }
+        total += n;
+    }
+
+    void merge(const BatchStats& o) {
+        for (int s : o.touched_states) {
+            if (!touched[s]) {
+                touched[s] = 1;
+                touched_states.push_back(s);
+            }
+            for (int a = 0; a < ACTIONS; ++a) {
+                table[static_cast<size_t>(s) * ACTIONS + a].merge(o.at(s, a));
+            }
+        }
+        total += o.total;
+    }
+
+    const PairStats& at(int s, int action) const { return table[static_cast<size_t>(s) * ACTIONS + action]; }
+    const std::vector<int>& states() const { return touched_states; }
+    double num_samples() const { return total; }
+};
+
+// Parallel compression with results that do not depend on the thread count.
+// The step range is cut into blocks whose boundaries depend only on the number of
+// steps; each block is compressed into its own partial table by whichever thread
+// picks it up, and partials are merged in a fixed pairwise tree (0+1, 2+3, ...,
+// then 0+2, ...). Floating-point sums are therefore bit-identical on 1 or N threads.
+class ParallelBatchCompressor {
+private:
+    static constexpr size_t MIN_BLOCK_STEPS = 1024;
+    static constexpr size_t MAX_BLOCKS = 64;
+
+    ThreadPool& pool;
+    std::vector<BatchStats> partials;  // reused across calls; clear() only touches visited rows
+
+public:
+    explicit ParallelBatchCompressor(ThreadPool& pool = default_thread_pool()) : pool(pool) {}
+
+    // add_range(BatchStats&, begin, end) records steps [begin, end) into the given table
+    template <typename AddRange>
+    void compress(BatchStats& out, size_t num_steps, AddRange&& add_range) {
+        out.clear();
+        size_t blocks = std::clamp<size_t>((num_steps + MIN_BLOCK_STEPS - 1) / MIN_BLOCK_STEPS, 1, MAX_BLOCKS);
+        if (blocks == 1) {
+            add_range(out, 0, num_steps);
+            return;
+        }
+        if (partials.size() < blocks) partials.resize(blocks);
+
+        pool.parallel_for(blocks, [&](size_t, size_t first, size_t last) {
+            for (size_t b = first; b < last; ++b) {
+                partials[b].clear();
+                add_range(partials[b], num_steps * b / blocks, num_steps * (b + 1) / blocks);
+            }
+        });
+
+        // fixed-order tree reduction; every level's merges are independent
+        for (size_t stride = 1; stride < blocks; stride *= 2) {
+            size_t pairs = (blocks + 2 * stride - 1) / (2 * stride);
+            pool.parallel_for(pairs, [&](size_t, size_t first, size_t last) {
+                for (size_t p = first; p < last; ++p) {
+                    size_t dst = p * 2 * stride;
+                    if (dst + stride < blocks) partials[dst].merge(partials[dst + stride]);
+                }
+            });
+        }
+        out.merge(partials[0]);
+    }
+};
+
+#endif //BATCH_STATS_H
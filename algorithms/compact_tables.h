@@ -0,0 +1,150 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef COMPACT_TABLES_H
+#define COMPACT_TABLES_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include "../env/gridworld.h"
+#include "../env/mdp_config.h"
+
+// Policy table packed at 3 bits per state (ACTIONS <= 8).
+// 21 entries share one 64-bit word so no entry straddles a word boundary.
+class PackedPolicy {
+private:
+    static constexpr int BITS = 3;
+    static constexpr int PER_WORD = 64 / BITS;
+    static constexpr uint64_t MASK = (uint64_t{1} << BITS) - 1;
+    static_assert(ACTIONS <= (1 << BITS), "actions must fit in 3 bits");
+
+    std::vector<uint64_t> words;
+    int rows, cols;
+
+public:
+    PackedPolicy(int rows = ROWS, int cols = COLS)
+        : words((static_cast<size_t>(rows) * cols + PER_WORD - 1) / PER_WORD, 0), rows(rows), cols(cols) {}
+
+    int get(int r, int c) const {
+        size_t i = static_cast<size_t>(r) * cols + c;
+        return static_cast<int>((words[i / PER_WORD] >> ((i % PER_WORD) * BITS)) & MASK);
+    }
+
+    void set(int r, int c, int action) {
+        size_t i = static_cast<size_t>(r) * cols + c;
+        int shift = static_cast<int>(i % PER_WORD) * BITS;
+        uint64_t& w = words[i / PER_WORD];
+        w = (w & ~(MASK << shift)) | ((static_cast<uint64_t>(action) & MASK) << shift);
+    }
+
+    // Expand to the nested layout used by print_policy and the other solvers
+    std::vector<std::vector<int>> unpack() const {
+        std::vector<std::vector<int>> policy(rows, std::vector<int>(cols));
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                policy[r][c] = get(r, c);
+            }
+        }
+        return policy;
+    }
+
+    size_t bytes() const { return words.size() * sizeof(uint64_t); }
+};
+
+// Bounds on any discounted state value for this grid: every reward lies in
+// [min_reward, max_reward], so V lies in [min(0,min_reward), max(0,max_reward)] / (1 - GAMMA)
+inline std::pair<double, double> value_bounds(const Grid& grid) {
+    double lo = 0.0, hi = 0.0;
+    for (const auto& row : grid) {
+        for (const auto& s : row) {
+            lo = std::min(lo, s.reward);
+            hi = std::max(hi, s.reward);
+        }
+    }
+    return {lo / (1.0 - GAMMA), hi / (1.0 - GAMMA)};
+}
+
+// State value table with reduced-precision storage.
+// Storage = float   : plain float32
+// Storage = uint16_t: 16-bit fixed point over [lo, hi]
+template <typename Storage>
+class CompactValueTable {
+private:
+    static_assert(std::is_same_v<Storage, float> || std::is_same_v<Storage, uint16_t>,
+                  "storage must be float or uint16_t");
+    static constexpr double LEVELS = 65535.0;
+
+    std::vector<Storage> data;
+    int rows, cols;
+    double lo, scale;  // only used by the 16-bit encoding
+
+public:
+    CompactValueTable(int rows = ROWS, int cols = COLS, double lo = 0.0, double hi = 1.0)
+        : data(static_cast<size_t>(rows) * cols), rows(rows), cols(cols),
+          lo(lo), scale((hi - lo) / LEVELS) {
+        fill(0.0);
+    }
+
+    // Table covering every value reachable on this grid
+    static CompactValueTable for_grid(const Grid& grid) {
+        auto [lo, hi] = value_bounds(grid);
+        return CompactValueTable(ROWS, COLS, lo, hi);
+    }
+
+    double get(int r, int c) const {
+        Storage s = data[static_cast<size_t>(r) * cols + c];
+        if constexpr (std::is_same_v<Storage, float>) {
+            return s;
+        } else {
+            return lo + s * scale;
+        }
+    }
+
+    void set(int r, int c, double value) {
+        data[static_cast<size_t>(r) * cols + c] = encode(value);
+    }
+
+    void fill(double value) {
+        std::fill(data.begin(), data.end(), encode(value));
+    }
+
+    // Smallest representable change; solvers cannot converge below this
+    double resolution(double value) const {
+        if constexpr (std::is_same_v<Storage, float>) {
+            return std::nextafter(static_cast<float>(std::fabs(value)), INFINITY) - std::fabs(value);
+        } else {
+            return scale;
+        }
+    }
+
+    std::vector<std::vector<double>> to_dense() const {
+        std::vector<std::vector<double>> V(rows, std::vector<double>(cols));
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                V[r][c] = get(r, c);
+            }
+        }
+        return V;
+    }
+
+    size_t bytes() const { return data.size() * sizeof(Storage); }
+
+private:
+    Storage encode(double value) const {
+        if constexpr (std::is_same_v<Storage, float>) {
+            return static_cast<float>(value);
+        } else {
+            double q = std::round((value - lo) / scale);
+            return static_cast<uint16_t>(std::clamp(q, 0.0, LEVELS));
+        }
+    }
+};
+
+using Float32ValueTable = CompactValueTable<float>;
+using Quantized16ValueTable = CompactValueTable<uint16_t>;
+
+#endif //COMPACT_TABLES_H
@@ -6,15 +6,27 @@
 #define DDPG_H
 
 #include <vector>
-#include <random>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
-#include <deque>
+#include <optional>
+#include <limits>
 #include "../env/gridworld.h"
 #include "../env/mdp_config.h"
+#include "policy_table.h"
+#include "replay_buffer.h"
+#include "prioritized_replay.h"
+#include "target_network.h"
+#include "episode_stream.h"
+#include "../utils/rng.h"
 
-// Experience replay buffer for DDPG
+// How ddpg() draws replay batches
+enum class ReplaySampling {
+    Uniform,     // uniform slots from the lock-free ring
+    Prioritized  // sum-tree prioritized replay with importance-sampling weights
+};
+
+// One DDPG transition in (r, c) form, as returned by run_episode_ddpg
 struct DDPGExperience {
     std::pair<int, int> state;      // Current state (r, c)
     int action;                     // Action taken
@@ -26,103 +38,60 @@ struct DDPGExperience {
         : state(s), action(a), reward(r), next_state(ns), done(d) {}
 };
 
-// Experience Replay Buffer
-class ReplayBuffer {
-private:
-    std::deque<DDPGExperience> buffer;
-    size_t max_size;
-    std::mt19937 rng;
-    
-public:
-    ReplayBuffer(size_t capacity = 10000) : max_size(capacity), rng(std::random_device{}()) {}
-    
-    void push(const DDPGExperience& exp) {
-        if (buffer.size() >= max_size) {
-            buffer.pop_front();
-        }
-        buffer.push_back(exp);
-    }
-    
-    std::vector<DDPGExperience> sample(size_t batch_size) {
-        std::vector<DDPGExperience> batch;
-        if (buffer.size() < batch_size) {
-            batch_size = buffer.size();
-        }
-        
-        std::uniform_int_distribution<size_t> dist(0, buffer.size() - 1);
-        for (size_t i = 0; i < batch_size; ++i) {
-            size_t idx = dist(rng);
-            batch.push_back(buffer[idx]);
-        }
-        return batch;
-    }
-    
-    size_t size() const { return buffer.size(); }
-};
-
 // Actor Network (Policy Network)
 class DDPGActor {
 private:
-    std::vector<std::vector<std::vector<double>>> theta;  // Actor parameters [state_r][state_c][action]
-    std::vector<std::vector<std::vector<double>>> target_theta;  // Target network parameters
-    std::mt19937 rng;
+    SoftmaxPolicy theta;  // Actor parameters [state][action] with cached probabilities
+    TargetNetwork target_theta;  // Target network parameters, tracking theta
+    Rng rng;  // Random number generator for the convenience overloads
+    
+    // Batch gradient scratch, reused across updates
+    TabularParams batch_grad;       // only rows listed in grad_states are non-zero
+    std::vector<int> grad_states;
+    std::vector<uint8_t> grad_touched;
     
 public:
-    DDPGActor() : rng(std::random_device{}()) {
-        // Initialize actor parameters
-        theta.assign(ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-        target_theta = theta;
-    }
+    explicit DDPGActor(uint64_t seed = DEFAULT_SEED, TargetUpdate target_mode = TargetUpdate::Lazy,
+                       double tau = 0.001)
+        : theta(0.0), target_theta(theta.params(), target_mode, tau), rng(seed),
+          batch_grad(0.0), grad_touched(NUM_STATES, 0) {}
     
     // Get action probabilities (softmax)
-    std::vector<double> get_action_probs(int r, int c) {
-        std::vector<double> logits = theta[r][c];
-        std::vector<double> probs(ACTIONS);
-        
-        // Compute softmax with numerical stability
-        double max_logit = *std::max_element(logits.begin(), logits.end());
-        double sum_exp = 0.0;
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] = std::exp(logits[a] - max_logit);
-            sum_exp += probs[a];
-        }
-        
-        // Normalize
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] /= sum_exp;
-        }
-        
-        return probs;
+    ActionProbs get_action_probs(int r, int c) {
+        return theta.probs(r, c);
     }
     
     // Get deterministic action (argmax)
     int get_action(int r, int c) {
-        std::vector<double> probs = get_action_probs(r, c);
-        return std::max_element(probs.begin(), probs.end()) - probs.begin();
+        return theta.argmax(r, c);
     }
     
     // Get action with exploration noise
-    int get_action_with_noise(int r, int c, double epsilon = 0.1) {
-        std::uniform_real_distribution<double> dist(0.0, 1.0);
-        if (dist(rng) < epsilon) {
+    int get_action_with_noise(int r, int c, Rng& gen, double epsilon = 0.1) {
+        if (gen.uniform01() < epsilon) {
             // Random action
-            std::uniform_int_distribution<int> action_dist(0, ACTIONS - 1);
-            return action_dist(rng);
+            return gen.uniform_int(ACTIONS);
         } else {
             // Deterministic action
             return get_action(r, c);
         }
     }
     
+    int get_action_with_noise(int r, int c, double epsilon = 0.1) {
+        return get_action_with_noise(r, c, rng, epsilon);
+    }
+    
     // Get action probability
     double get_action_prob(int r, int c, int action) {
-        std::vector<double> probs = get_action_probs(r, c);
-        return probs[action];
+        return theta.probs(r, c)[action];
     }
     
+    // Raw logit table (for published snapshots)
+    const TabularParams& params() const { return theta.params(); }
+    
     // Update actor parameters
     void update_actor(const std::vector<DDPGExperience>& batch, 
-                     const std::vector<std::vector<std::vector<double>>>& q_gradients,
+                     const TabularParams& q_gradients,
                      double lr = 0.001) {
         
         for (const auto& exp : batch) {
@@ -131,26 +100,64 @@ public:
             int action = exp.action;
             
             // Update actor parameters using Q-function gradients
-            std::vector<double> probs = get_action_probs(r, c);
+            ActionProbs probs = theta.probs(r, c);
+            target_theta.before_write(state_index(r, c));
+            double* row = theta.mutable_row(r, c);
+            const double* q = q_gradients.row(r, c);
             for (int a = 0; a < ACTIONS; ++a) {
                 if (a == action) {
-                    theta[r][c][a] += lr * q_gradients[r][c][a] * (1.0 - probs[a]);
+                    row[a] += lr * q[a] * (1.0 - probs[a]);
                 } else {
-                    theta[r][c][a] += lr * q_gradients[r][c][a] * (-probs[a]);
+                    row[a] += lr * q[a] * (-probs[a]);
                 }
             }
         }
     }
     
-    // Update target network
-    void update_target(double tau = 0.001) {
-        for (int r = 0; r < ROWS; ++r) {
-            for (int c = 0; c < COLS; ++c) {
-                for (int a = 0; a < ACTIONS; ++a) {
-                    target_theta[r][c][a] = tau * theta[r][c][a] + (1.0 - tau) * target_theta[r][c][a];
-                }
+    // Batched update from a sampled index batch. Each sample reads its state's critic Q row
+    // in place (Q_row(s) is the gradient signal) and accumulates into a sparse scratch row;
+    // the touched actor rows are then stepped once, so a sample costs O(ACTIONS).
+    // Critic is DDPGCritic, which is declared below.
+    template <typename Critic>
+    void update_actor(const ReplayBuffer& replay, const std::vector<uint32_t>& batch,
+                      const Critic& critic, double lr = 0.001) {
+        for (uint32_t idx : batch) {
+            Transition t = replay.load(idx);
+            int s = static_cast<int>(t.state);
+            if (!grad_touched[s]) {
+                grad_touched[s] = 1;
+                grad_states.push_back(s);
             }
+            const ActionProbs& probs = theta.probs(s);
+            const double* q = critic.q_row(s);
+            double* grad = batch_grad.row(s);
+            for (int a = 0; a < ACTIONS; ++a) {
+                grad[a] -= q[a] * probs[a];
+            }
+            grad[t.action] += q[t.action];
         }
+        
+        for (int s : grad_states) {
+            target_theta.before_write(s);
+            double* row = theta.mutable_row(s);
+            double* grad = batch_grad.row(s);
+            for (int a = 0; a < ACTIONS; ++a) {
+                row[a] += lr * grad[a];
+                grad[a] = 0.0;
+            }
+            grad_touched[s] = 0;
+        }
+        grad_states.clear();
+    }
+    
+    // Update target network
+    void update_target(double tau = 0.001) {
+        target_theta.step(tau);
+    }
+    
+    // Target actor parameters, fully synchronised
+    const TabularParams& get_target_params() {
+        return target_theta.params();
     }
     
     // Get optimal policy
@@ -168,30 +175,31 @@ public:
 // Critic Network (Q-function)
 class DDPGCritic {
 private:
-    std::vector<std::vector<std::vector<double>>> Q;  // Q-function [state_r][state_c][action]
-    std::vector<std::vector<std::vector<double>>> target_Q;  // Target Q-function
-    std::mt19937 rng;
+    TabularParams Q;  // Q-function [state][action]
+    TargetNetwork target_Q;  // Target Q-function, tracking Q
     
 public:
-    DDPGCritic() : rng(std::random_device{}()) {
-        // Initialize Q-function
-        Q.assign(ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-        target_Q = Q;
-    }
+    explicit DDPGCritic(TargetUpdate target_mode = TargetUpdate::Lazy, double tau = 0.001)
+        : Q(0.0), target_Q(Q, target_mode, tau) {}
+    
+    // Q row of state s, read in place by the batched actor update
+    const double* q_row(int s) const { return Q.row(s); }
     
     // Get Q-value
     double get_q_value(int r, int c, int action) {
-        return Q[r][c][action];
+        return Q(r, c, action);
     }
     
     // Get max Q-value for a state
     double get_max_q_value(int r, int c) {
-        return *std::max_element(Q[r][c].begin(), Q[r][c].end());
+        const double* q = Q.row(r, c);
+        return *std::max_element(q, q + ACTIONS);
     }
     
     // Get target max Q-value for a state
     double get_target_max_q_value(int r, int c) {
-        return *std::max_element(target_Q[r][c].begin(), target_Q[r][c].end());
+        const double* q = target_Q.row(state_index(r, c));
+        return *std::max_element(q, q + ACTIONS);
     }
     
     // Update Q-function
@@ -212,82 +220,99 @@ public:
             }
             
             // Update Q-value
-            Q[r][c][action] += lr * (target_q - Q[r][c][action]);
+            target_Q.before_write(state_index(r, c));
+            Q(r, c, action) += lr * (target_q - Q(r, c, action));
         }
     }
     
-    // Update target network
-    void update_target(double tau = 0.001) {
-        for (int r = 0; r < ROWS; ++r) {
-            for (int c = 0; c < COLS; ++c) {
-                for (int a = 0; a < ACTIONS; ++a) {
-                    target_Q[r][c][a] = tau * Q[r][c][a] + (1.0 - tau) * target_Q[r][c][a];
-                }
+    // Same update reading a sampled index batch straight from the replay ring
+    void update_critic(const ReplayBuffer& replay, const std::vector<uint32_t>& batch, double lr = 0.001) {
+        for (uint32_t idx : batch) {
+            Transition t = replay.load(idx);
+            
+            // Compute target Q-value
+            double target_q = t.reward;
+            if (!t.done) {
+                const double* next_q = target_Q.row(t.next_state);
+                target_q += GAMMA * *std::max_element(next_q, next_q + ACTIONS);
             }
+            
+            // Update Q-value
+            target_Q.before_write(t.state);
+            double& q = Q.row(t.state)[t.action];
+            q += lr * (target_q - q);
         }
     }
     
-    // Compute gradients for actor update
-    std::vector<std::vector<std::vector<double>>> compute_q_gradients(int r, int c) {
-        std::vector<std::vector<std::vector<double>>> gradients(
-            ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
+    // Prioritized variant: each step is scaled by its importance-sampling weight, and the
+    // TD errors (before the step) are written to td_errors to serve as new priorities
+    void update_critic(const ReplayBuffer& replay, const std::vector<uint32_t>& batch,
+                       const std::vector<double>& weights, std::vector<double>& td_errors,
+                       double lr = 0.001) {
+        td_errors.resize(batch.size());
+        for (size_t k = 0; k < batch.size(); ++k) {
+            Transition t = replay.load(batch[k]);
+            
+            // Compute target Q-value
+            double target_q = t.reward;
+            if (!t.done) {
+                const double* next_q = target_Q.row(t.next_state);
+                target_q += GAMMA * *std::max_element(next_q, next_q + ACTIONS);
+            }
+            
+            // Weighted update of the Q-value
+            target_Q.before_write(t.state);
+            double& q = Q.row(t.state)[t.action];
+            td_errors[k] = target_q - q;
+            q += lr * weights[k] * td_errors[k];
+        }
+    }
+    
+    // Update target network
+    void update_target(double tau = 0.001) {
+        target_Q.step(tau);
+    }
+    
+    // Dense gradient table for the per-experience actor update (the batched update reads q_row instead)
+    TabularParams compute_q_gradients(int r, int c) {
+        TabularParams gradients(0.0);
         
         // For discrete actions, we use the Q-values directly as gradients
-        for (int a = 0; a < ACTIONS; ++a) {
-            gradients[r][c][a] = Q[r][c][a];
-        }
+        std::copy_n(Q.row(r, c), ACTIONS, gradients.row(r, c));
         
         return gradients;
     }
 };
 
-// Run episode and collect experiences
+// Exploring DDPG episode as a lazy transition stream; the actor is read at every step,
+// so updates made while consuming the stream take effect within the episode
+inline Generator<Transition> ddpg_episode_stream(const Grid& grid, DDPGActor& actor, Rng& rng,
+                                                 double epsilon = 0.1, int max_steps = 1000) {
+    return episode_stream(grid, rng, [&actor, epsilon](int r, int c, Rng& gen) {
+        return actor.get_action_with_noise(r, c, gen, epsilon);
+    }, max_steps);
+}
+
+// Run episode and collect experiences (Replay is ReplayBuffer or PrioritizedReplay)
+template <typename Replay>
 std::vector<DDPGExperience> run_episode_ddpg(const Grid& grid, DDPGActor& actor, 
-                                            ReplayBuffer& replay_buffer, int max_steps = 1000) {
+                                            Replay& replay_buffer, Rng& rng,
+                                            int max_steps = 1000) {
     std::vector<DDPGExperience> episode_experiences;
-    
-    // Random starting state (avoid forbidden areas)
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<int> dist_r(0, ROWS - 1);
-    std::uniform_int_distribution<int> dist_c(0, COLS - 1);
-    
-    int r, c;
-    do {
-        r = dist_r(rng);
-        c = dist_c(rng);
-    } while (grid[r][c].type == StateType::Forbidden);
-    
-    for (int step = 0; step < max_steps; ++step) {
-        // Get action with exploration
-        int action = actor.get_action_with_noise(r, c, 0.1);
-        
-        // Execute action
-        auto [next_r, next_c] = next_state(r, c, static_cast<Action>(action), grid);
-        
-        // Get reward
-        double reward = grid[next_r][next_c].reward;
-        
-        // Check if episode ended
-        bool done = (grid[next_r][next_c].type == StateType::Terminal || 
-                    grid[next_r][next_c].type == StateType::Forbidden);
-        
+    for (const Transition& t : ddpg_episode_stream(grid, actor, rng, 0.1, max_steps)) {
         // Store experience
-        DDPGExperience exp({r, c}, action, reward, {next_r, next_c}, done);
-        episode_experiences.push_back(exp);
-        replay_buffer.push(exp);
-        
-        if (done) {
-            break;
-        }
-        
-        r = next_r;
-        c = next_c;
+        episode_experiences.emplace_back(std::make_pair(state_row(t.state), state_col(t.state)), t.action, t.reward,
+                                         std::make_pair(state_row(t.next_state), state_col(t.next_state)), t.done);
+        replay_buffer.push(t.state, t.action, t.reward, t.next_state, t.done);
     }
-    
     return episode_experiences;
 }
 
-// DDPG main function
+// DDPG main function. update_every = 0 learns once after each episode; k > 0 learns every
+// k environment steps while the episode is still running. logger, if given, sees every step.
+// Episodes are cut off after time_limit steps; the last stored step then is not done, so the
+// critic bootstraps it from Q(s', .) rather than treating the time limit as terminal.
+// total_steps > 0 trains for that many environment steps instead of num_episodes episodes.
 void ddpg(const Grid& grid, 
           std::vector<std::vector<double>>& V, 
           std::vector<std::vector<int>>& policy,
@@ -295,35 +320,86 @@ void ddpg(const Grid& grid,
           int batch_size = 32,
           double actor_lr = 0.001,
           double critic_lr = 0.001,
-          double tau = 0.001) {
+          double tau = 0.001,
+          uint64_t seed = DEFAULT_SEED,
+          ReplaySampling replay_mode = ReplaySampling::Uniform,
+          TargetUpdate target_mode = TargetUpdate::Lazy,
+          int update_every = 0,
+          EpisodeLogger* logger = nullptr,
+          int time_limit = DEFAULT_TIME_LIMIT,
+          long long total_steps = 0) {
     
-    DDPGActor actor;
-    DDPGCritic critic;
-    ReplayBuffer replay_buffer(10000);
+    constexpr size_t REPLAY_CAPACITY = 10000;
+    constexpr double PER_ALPHA = 0.6;      // Priority exponent
+    constexpr double PER_BETA_START = 0.4; // IS exponent, annealed to 1 over training
     
-    for (int episode = 0; episode < num_episodes; ++episode) {
-        // Run episode and collect experiences
-        auto episode_experiences = run_episode_ddpg(grid, actor, replay_buffer);
-        
-        // Update networks if enough experiences
-        if (replay_buffer.size() >= batch_size) {
-            // Sample batch from replay buffer
-            auto batch = replay_buffer.sample(batch_size);
+    DDPGActor actor(seed, target_mode, tau);
+    DDPGCritic critic(target_mode, tau);
+    RngStreams streams(seed);  // One independent stream per episode, plus one for replay sampling
+    std::optional<ReplayBuffer> uniform_replay;
+    std::optional<PrioritizedReplay> prioritized_replay;
+    if (replay_mode == ReplaySampling::Prioritized) {
+        prioritized_replay.emplace(REPLAY_CAPACITY, PER_ALPHA);
+    } else {
+        uniform_replay.emplace(REPLAY_CAPACITY);
+    }
+    const ReplayBuffer& ring = prioritized_replay ? prioritized_replay->buffer() : *uniform_replay;
+    const bool step_budget = total_steps > 0;
+    // Replay sampling uses the stream after the last episode's (the last id when the episode count is open)
+    Rng sample_rng = streams.stream(step_budget ? ~0ull : static_cast<uint64_t>(num_episodes));
+    std::vector<uint32_t> batch;  // Sampled slot indices, reused across updates
+    std::vector<double> is_weights, td_errors;
+    
+    long long steps = 0;
+    
+    // One learning step from a replay batch, once the replay holds batch_size transitions
+    auto learn = [&](int episode) {
+        if (ring.size() < static_cast<size_t>(batch_size)) return;
+        if (prioritized_replay) {
+            // Stratified prioritized batch; TD errors become the new priorities
+            double progress = step_budget ? static_cast<double>(steps) / total_steps
+                                          : static_cast<double>(episode) / std::max(1, num_episodes - 1);
+            double beta = PER_BETA_START + (1.0 - PER_BETA_START) * std::min(1.0, progress);
+            prioritized_replay->sample(batch_size, beta, sample_rng, batch, is_weights);
+            critic.update_critic(ring, batch, is_weights, td_errors, critic_lr);
+            prioritized_replay->update_priorities(batch, td_errors);
+        } else {
+            // Sample slot indices from replay buffer
+            uniform_replay->sample(batch_size, sample_rng, batch);
             
             // Update critic
-            critic.update_critic(batch, critic_lr);
-            
-            // Update actor
-            for (const auto& exp : batch) {
-                auto q_gradients = critic.compute_q_gradients(exp.state.first, exp.state.second);
-                std::vector<DDPGExperience> single_exp = {exp};
-                actor.update_actor(single_exp, q_gradients, actor_lr);
+            critic.update_critic(ring, batch, critic_lr);
+        }
+        
+        // Update actor from the critic's Q rows of the sampled states
+        actor.update_actor(ring, batch, critic, actor_lr);
+        
+        // Update target networks
+        actor.update_target(tau);
+        critic.update_target(tau);
+    };
+    
+    for (int episode = 0; step_budget ? steps < total_steps : episode < num_episodes; ++episode) {
+        // Stream the episode: each transition goes to the replay (and logger) as it happens
+        Rng rng = streams.stream(episode);
+        int limit = time_limit > 0 ? time_limit : std::numeric_limits<int>::max();
+        if (step_budget) limit = static_cast<int>(std::min<long long>(limit, total_steps - steps));
+        for (const Transition& t : ddpg_episode_stream(grid, actor, rng, 0.1, limit)) {
+            if (prioritized_replay) {
+                prioritized_replay->push(t.state, t.action, t.reward, t.next_state, t.done);
+            } else {
+                uniform_replay->push(t.state, t.action, t.reward, t.next_state, t.done);
             }
+            if (logger) logger->observe(t);
             
-            // Update target networks
-            actor.update_target(tau);
-            critic.update_target(tau);
+            // Per-step learning: the next action already uses the updated actor
+            ++steps;
+            if (update_every > 0 && steps % update_every == 0) learn(episode);
         }
+        if (logger) logger->end_episode();  // no-op unless the episode hit max_steps
+        
+        // Default: one update per finished episode
+        if (update_every <= 0) learn(episode);
     }
     
     // Get final optimal policy
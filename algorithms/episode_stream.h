@@ -0,0 +1,159 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef EPISODE_STREAM_H
+#define EPISODE_STREAM_H
+
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include "../env/gridworld.h"
+#include "../env/mdp_config.h"
+#include "replay_buffer.h"
+#include "../utils/rng.h"
+#include "../utils/generator.h"
+
+// Streaming episodes: the environment loop as a coroutine that yields one Transition per
+// step. Consumers (replay insertion, n-step returns, logging, per-step learning) see each
+// step as soon as it happens, and the action of step t + 1 is chosen only after they have
+// handled step t, so an update made inside the loop already steers the rest of the episode.
+// Nothing is materialised: memory stays O(1) however long the episode.
+
+// Random non-forbidden start, then select_action(r, c, rng) -> action until a terminal or
+// forbidden cell or max_steps. grid and rng are held by reference and must outlive the
+// generator; select_action is copied into it.
+template <typename SelectAction>
+Generator<Transition> episode_stream(const Grid& grid, Rng& rng, SelectAction select_action,
+                                     int max_steps = 1000) {
+    // Random starting state (avoid forbidden areas)
+    int r, c;
+    do {
+        r = rng.uniform_int(ROWS);
+        c = rng.uniform_int(COLS);
+    } while (grid[r][c].type == StateType::Forbidden);
+
+    for (int step = 0; step < max_steps; ++step) {
+        int action = select_action(r, c, rng);
+        auto [next_r, next_c] = next_state(r, c, static_cast<Action>(action), grid);
+        bool done = grid[next_r][next_c].type != StateType::Normal;
+        co_yield Transition{static_cast<uint32_t>(state_index(r, c)),
+                            static_cast<uint32_t>(state_index(next_r, next_c)),
+                            static_cast<uint8_t>(action),
+                            static_cast<float>(grid[next_r][next_c].reward),
+                            done};
+        if (done) co_return;
+        r = next_r;
+        c = next_c;
+    }
+}
+
+// n-step transition: reward is sum_{k<m} gamma^k r_k over m <= n steps, and the target is
+// reward + discount * V(bootstrap_state), with discount = gamma^m (0 once the episode ended)
+struct NStepTransition {
+    uint32_t state;
+    uint8_t action;
+    double reward;
+    uint32_t bootstrap_state;
+    double discount;
+};
+
+// Turns a transition stream into n-step transitions with a window of the last n steps.
+// push() emits the transition starting n steps back once the window is full, and every
+// pending one when the episode ends; call flush() if the stream stops without a terminal
+// step (time limit), which bootstraps the pending ones from the last next_state.
+class NStepReturnBuilder {
+private:
+    std::vector<Transition> window;  // ring of the last n steps
+    size_t head = 0;                 // oldest entry
+    size_t count = 0;
+    double gamma;
+
+    // Transition starting at the oldest window entry, then drop that entry
+    template <typename Emit>
+    void emit_oldest(Emit& emit) {
+        const Transition& first = window[head];
+        const Transition& last = window[(head + count - 1) % window.size()];
+        double reward = 0.0, discount = 1.0;
+        for (size_t k = 0; k < count; ++k) {
+            reward += discount * window[(head + k) % window.size()].reward;
+            discount *= gamma;
+        }
+        emit(NStepTransition{first.state, first.action, reward, last.next_state, last.done ? 0.0 : discount});
+        head = (head + 1) % window.size();
+        --count;
+    }
+
+public:
+    explicit NStepReturnBuilder(int n, double gamma = GAMMA)
+        : window(static_cast<size_t>(n > 0 ? n : 1)), gamma(gamma) {}
+
+    size_t n() const { return window.size(); }
+
+    template <typename Emit>
+    void push(const Transition& t, Emit&& emit) {
+        window[(head + count) % window.size()] = t;
+        ++count;
+        if (t.done) {
+            flush(emit);
+        } else if (count == window.size()) {
+            emit_oldest(emit);
+        }
+    }
+
+    template <typename Emit>
+    void flush(Emit&& emit) {
+        while (count > 0) emit_oldest(emit);
+        head = 0;
+    }
+};
+
+// Online episode statistics, updated per transition; optionally prints a summary line
+// every log_every finished episodes
+class EpisodeLogger {
+private:
+    std::ostream* out;
+    int log_every;
+    int episodes = 0;
+    long long steps = 0;
+    long long finished_steps = 0;  // steps of finished episodes
+    double total_return = 0.0;    // sum over finished episodes
+    double episode_return = 0.0;  // discounted return of the running episode
+    double gamma_power = 1.0;
+    int episode_steps = 0;
+
+public:
+    explicit EpisodeLogger(std::ostream* out = nullptr, int log_every = 100)
+        : out(out), log_every(log_every) {}
+
+    void observe(const Transition& t) {
+        episode_return += gamma_power * t.reward;
+        gamma_power *= GAMMA;
+        ++episode_steps;
+        ++steps;
+        if (t.done) end_episode();
+    }
+
+    // Close the running episode (called automatically on a terminal transition)
+    void end_episode() {
+        if (episode_steps == 0) return;
+        ++episodes;
+        total_return += episode_return;
+        finished_steps += episode_steps;
+        if (out && log_every > 0 && episodes % log_every == 0) {
+            *out << "episode " << episodes << ": " << episode_steps << " steps, return "
+                 << episode_return << ", mean return " << mean_return() << "\n";
+        }
+        episode_return = 0.0;
+        gamma_power = 1.0;
+        episode_steps = 0;
+    }
+
+    int num_episodes() const { return episodes; }
+    long long num_steps() const { return steps; }
+    double mean_return() const { return episodes > 0 ? total_return / episodes : 0.0; }
+    double mean_length() const { return episodes > 0 ? static_cast<double>(finished_steps) / episodes : 0.0; }
+};
+
+#endif //EPISODE_STREAM_H
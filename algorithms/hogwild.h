@@ -0,0 +1,314 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef HOGWILD_H
+#define HOGWILD_H
+
+#include <vector>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include "../env/gridworld.h"
+#include "../env/mdp_config.h"
+#include "policy_table.h"
+#include "../utils/rng.h"
+
+// Hogwild (Niu et al.) training on shared tabular parameters.
+// Worker threads each claim episodes, act on the shared tables and apply their own
+// updates immediately with relaxed atomic adds: no lock, no barrier, no batching. An
+// update touches one or two rows, so concurrent writers rarely meet, and when they do
+// each add still lands (fetch_add never loses an increment); a reader may see a row
+// half-way through another thread's update, which Hogwild tolerates by design.
+// Reads are uncached softmaxes, since a per-state cache would need invalidation.
+// Results depend on thread timing and are not reproducible run to run.
+
+// Relaxed atomic access to plain table entries
+inline double relaxed_load(const double& x) {
+    return std::atomic_ref<double>(const_cast<double&>(x)).load(std::memory_order_relaxed);
+}
+inline void relaxed_add(double& x, double delta) {
+    std::atomic_ref<double>(x).fetch_add(delta, std::memory_order_relaxed);
+}
+// Snapshot of a row's action lanes into an ACTION_STRIDE-wide buffer, padding lanes zeroed
+inline void relaxed_row(const double* row, double* out) {
+    for (int a = 0; a < ACTIONS; ++a) out[a] = relaxed_load(row[a]);
+    for (int a = ACTIONS; a < ACTION_STRIDE; ++a) out[a] = 0.0;
+}
+
+// Throughput and quality of one training run
+struct HogwildReport {
+    int threads = 1;
+    double seconds = 0.0;
+    double episodes_per_second = 0.0;
+    double steps_per_second = 0.0;  // 0 when the trainer does not count steps
+    double greedy_return = 0.0;     // see greedy_policy_return
+};
+
+// Quality of a deterministic policy: mean discounted return over every non-forbidden,
+// non-terminal start state, following the policy for at most max_steps
+inline double greedy_policy_return(const Grid& grid, const std::vector<std::vector<int>>& policy,
+                                   int max_steps = 100) {
+    double total = 0.0;
+    int starts = 0;
+    for (int r0 = 0; r0 < ROWS; ++r0) {
+        for (int c0 = 0; c0 < COLS; ++c0) {
+            if (grid[r0][c0].type != StateType::Normal) continue;
+            int r = r0, c = c0;
+            double ret = 0.0, gamma_power = 1.0;
+            for (int step = 0; step < max_steps; ++step) {
+                auto [next_r, next_c] = next_state(r, c, static_cast<Action>(policy[r][c]), grid);
+                ret += gamma_power * grid[next_r][next_c].reward;
+                gamma_power *= GAMMA;
+                if (grid[next_r][next_c].type != StateType::Normal) break;
+                r = next_r;
+                c = next_c;
+            }
+            total += ret;
+            ++starts;
+        }
+    }
+    return starts > 0 ? total / starts : 0.0;
+}
+
+// Time a synchronous trainer call on the same footing as the Hogwild reports.
+// If train() returns the number of environment steps it took, steps/s is reported too.
+template <typename Train>
+HogwildReport time_training(const Grid& grid, const std::vector<std::vector<int>>& policy,
+                            int num_episodes, int threads, Train&& train) {
+    long long steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    if constexpr (std::is_void_v<std::invoke_result_t<Train&>>) {
+        train();
+    } else {
+        steps = static_cast<long long>(train());
+    }
+    HogwildReport report;
+    report.threads = threads;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (report.seconds > 0.0) {
+        report.episodes_per_second = num_episodes / report.seconds;
+        report.steps_per_second = static_cast<double>(steps) / report.seconds;
+    }
+    report.greedy_return = greedy_policy_return(grid, policy);
+    return report;
+}
+
+namespace hogwild_detail {
+
+inline int random_start(const Grid& grid, Rng& rng) {
+    int r, c;
+    do {
+        r = rng.uniform_int(ROWS);
+        c = rng.uniform_int(COLS);
+    } while (grid[r][c].type == StateType::Forbidden);
+    return state_index(r, c);
+}
+
+// Per-episode step cap for a time_limit argument (0 = never)
+inline int step_cap(int time_limit) {
+    return time_limit > 0 ? time_limit : std::numeric_limits<int>::max();
+}
+
+// Run worker(episode) -> steps for every episode id on num_threads threads
+// and fill in the timing part of the report. total_steps > 0 replaces num_episodes with
+// an environment-step budget: threads stop claiming episodes once it is reached, so at
+// most num_threads episodes in flight run past it.
+template <typename Worker>
+HogwildReport run_workers(int num_episodes, int num_threads, Worker&& worker, long long total_steps = 0) {
+    if (num_threads <= 0) num_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<int> next_episode{0};
+    std::atomic<int> finished_episodes{0};
+    std::atomic<long long> collected_steps{0};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int k = 0; k < num_threads; ++k) {
+        threads.emplace_back([&] {
+            while (true) {
+                if (total_steps > 0 && collected_steps.load(std::memory_order_relaxed) >= total_steps) break;
+                int episode = next_episode.fetch_add(1, std::memory_order_relaxed);
+                if (total_steps <= 0 && episode >= num_episodes) break;
+                collected_steps.fetch_add(worker(episode), std::memory_order_relaxed);
+                finished_episodes.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    HogwildReport report;
+    report.threads = num_threads;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (report.seconds > 0.0) {
+        report.episodes_per_second = finished_episodes.load() / report.seconds;
+        report.steps_per_second = static_cast<double>(collected_steps.load()) / report.seconds;
+    }
+    return report;
+}
+
+}  // namespace hogwild_detail
+
+// REINFORCE with per-episode Hogwild updates on one shared logit table.
+// Each finished episode applies lr * G * (onehot(a_t) - pi(.|s_t)) for all its steps,
+// the same per-episode gradient the synchronous trainer sums over a batch.
+// Episodes are cut after time_limit steps (0 = never). G is a Monte Carlo return with no
+// value estimate to bootstrap from, so a cut episode keeps its partial return, as in
+// reinforce(), whose 1000-step cap is the default here. total_steps > 0 sets an
+// environment-step budget instead of num_episodes (see run_workers).
+HogwildReport reinforce_hogwild(const Grid& grid,
+                                std::vector<std::vector<double>>& V,
+                                std::vector<std::vector<int>>& policy,
+                                int num_episodes = 1000,
+                                double learning_rate = 0.01,
+                                int num_threads = 0,
+                                uint64_t seed = DEFAULT_SEED,
+                                int time_limit = 1000,
+                                long long total_steps = 0) {
+    const int max_steps = hogwild_detail::step_cap(time_limit);
+    TabularParams theta(0.0);
+    RngStreams streams(seed);
+
+    HogwildReport report = hogwild_detail::run_workers(num_episodes, num_threads, [&](int episode) {
+        Rng rng = streams.stream(static_cast<uint64_t>(episode));
+        thread_local std::vector<int> states, actions;
+        states.clear();
+        actions.clear();
+
+        int s = hogwild_detail::random_start(grid, rng);
+        double total_return = 0.0, gamma_power = 1.0;
+        for (int step = 0; step < max_steps; ++step) {
+            alignas(TABLE_ALIGNMENT) double logits[ACTION_STRIDE];
+            relaxed_row(theta.row(s), logits);
+            int action = sample_from_logits(logits, rng);
+            auto [next_r, next_c] = next_state(state_row(s), state_col(s), static_cast<Action>(action), grid);
+            states.push_back(s);
+            actions.push_back(action);
+            total_return += gamma_power * grid[next_r][next_c].reward;
+            gamma_power *= GAMMA;
+            if (grid[next_r][next_c].type != StateType::Normal) break;
+            s = state_index(next_r, next_c);
+        }
+
+        // Apply this episode's gradient directly to the shared table
+        for (size_t t = 0; t < states.size(); ++t) {
+            alignas(TABLE_ALIGNMENT) double logits[ACTION_STRIDE], probs[ACTION_STRIDE];
+            double* row = theta.row(states[t]);
+            relaxed_row(row, logits);
+            softmax_row(logits, probs);
+            for (int a = 0; a < ACTIONS; ++a) {
+                double onehot = a == actions[t] ? 1.0 : 0.0;
+                relaxed_add(row[a], learning_rate * total_return * (onehot - probs[a]));
+            }
+        }
+        return static_cast<long long>(states.size());
+    }, total_steps);
+
+    // Greedy policy and one-step expected values, as the synchronous trainer reports them
+    policy.assign(ROWS, std::vector<int>(COLS));
+    V.assign(ROWS, std::vector<double>(COLS, 0.0));
+    for (int r = 0; r < ROWS; ++r) {
+        for (int c = 0; c < COLS; ++c) {
+            policy[r][c] = argmax_row(theta.row(r, c));
+            if (grid[r][c].type != StateType::Normal) {
+                V[r][c] = grid[r][c].reward;
+            } else {
+                alignas(TABLE_ALIGNMENT) double probs[ACTION_STRIDE];
+                softmax_row(theta.row(r, c), probs);
+                for (int a = 0; a < ACTIONS; ++a) {
+                    auto [next_r, next_c] = next_state(r, c, static_cast<Action>(a), grid);
+                    V[r][c] += probs[a] * (grid[next_r][next_c].reward + GAMMA * V[next_r][next_c]);
+                }
+            }
+        }
+    }
+    report.greedy_return = greedy_policy_return(grid, policy);
+    return report;
+}
+
+// DDPG-style actor-critic with Hogwild updates of the shared critic (and actor) tables.
+// Every transition is learned from as it happens: a TD(0) step on Q(s, a) bootstrapped
+// from the online critic, then the DDPG actor step on row s driven by the critic's Q row.
+// There is no replay buffer and no target network here: both exist to decorrelate a
+// single learner, and syncing a target would reintroduce a global barrier.
+// Episodes are cut after time_limit steps (0 = never), like ddpg(): the last step is not
+// terminal, so its TD target still bootstraps from max Q(s', .). total_steps > 0 sets an
+// environment-step budget instead of num_episodes (see run_workers).
+HogwildReport ddpg_hogwild(const Grid& grid,
+                           std::vector<std::vector<double>>& V,
+                           std::vector<std::vector<int>>& policy,
+                           int num_episodes = 1000,
+                           double actor_lr = 0.001,
+                           double critic_lr = 0.001,
+                           int num_threads = 0,
+                           uint64_t seed = DEFAULT_SEED,
+                           double epsilon = 0.1,
+                           int time_limit = DEFAULT_TIME_LIMIT,
+                           long long total_steps = 0) {
+    const int max_steps = hogwild_detail::step_cap(time_limit);
+    TabularParams actor(0.0), Q(0.0);
+    RngStreams streams(seed);
+
+    HogwildReport report = hogwild_detail::run_workers(num_episodes, num_threads, [&](int episode) {
+        Rng rng = streams.stream(static_cast<uint64_t>(episode));
+        int s = hogwild_detail::random_start(grid, rng);
+        long long steps = 0;
+        for (int step = 0; step < max_steps; ++step, ++steps) {
+            alignas(TABLE_ALIGNMENT) double logits[ACTION_STRIDE];
+            relaxed_row(actor.row(s), logits);
+            int action = rng.uniform01() < epsilon ? rng.uniform_int(ACTIONS) : argmax_row(logits);
+            auto [next_r, next_c] = next_state(state_row(s), state_col(s), static_cast<Action>(action), grid);
+            double reward = grid[next_r][next_c].reward;
+            bool done = grid[next_r][next_c].type != StateType::Normal;
+            int next_s = state_index(next_r, next_c);
+
+            // Critic: TD(0) step on the shared Q table
+            double target_q = reward;
+            if (!done) {
+                alignas(TABLE_ALIGNMENT) double next_q[ACTION_STRIDE];
+                relaxed_row(Q.row(next_s), next_q);
+                target_q += GAMMA * next_q[argmax_row(next_q)];
+            }
+            double* q_row = Q.row(s);
+            relaxed_add(q_row[action], critic_lr * (target_q - relaxed_load(q_row[action])));
+
+            // Actor: same update as DDPGActor::update_actor, one sample
+            alignas(TABLE_ALIGNMENT) double q[ACTION_STRIDE], probs[ACTION_STRIDE];
+            relaxed_row(q_row, q);
+            softmax_row(logits, probs);
+            double* actor_row = actor.row(s);
+            for (int a = 0; a < ACTIONS; ++a) {
+                double onehot = a == action ? 1.0 : 0.0;
+                relaxed_add(actor_row[a], actor_lr * q[a] * (onehot - probs[a]));
+            }
+
+            if (done) {
+                ++steps;
+                break;
+            }
+            s = next_s;
+        }
+        return steps;
+    }, total_steps);
+
+    policy.assign(ROWS, std::vector<int>(COLS));
+    V.assign(ROWS, std::vector<double>(COLS, 0.0));
+    for (int r = 0; r < ROWS; ++r) {
+        for (int c = 0; c < COLS; ++c) {
+            policy[r][c] = argmax_row(actor.row(r, c));
+            if (grid[r][c].type != StateType::Normal) {
+                V[r][c] = grid[r][c].reward;
+            } else {
+                // Use max Q-value as state value
+                V[r][c] = *std::max_element(Q.row(r, c), Q.row(r, c) + ACTIONS);
+            }
+        }
+    }
+    report.greedy_return = greedy_policy_return(grid, policy);
+    return report;
+}
+
+#endif //HOGWILD_H
@@ -0,0 +1,267 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef IMPALA_H
+#define IMPALA_H
+
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include "../env/gridworld.h"
+#include "../env/mdp_config.h"
+#include "policy_table.h"
+#include "rollout_buffer.h"
+#include "ppo.h"
+#include "../utils/rng.h"
+#include "../utils/mpmc_queue.h"
+
+// V-trace truncation levels (Espeholt et al. use 1 for both)
+constexpr double VTRACE_RHO_BAR = 1.0;
+constexpr double VTRACE_C_BAR = 1.0;
+
+// One episode produced by an actor thread
+struct ImpalaUnroll {
+    RolloutBuffer steps;          // states, actions, rewards and behaviour log-probabilities
+    int32_t bootstrap_state = -1; // state after the last step if the episode was cut off, -1 if it ended
+    uint64_t policy_version = 0;  // snapshot version the actor sampled from
+};
+
+// Telemetry of an impala() run
+struct ImpalaStats {
+    int episodes = 0;
+    int updates = 0;
+    long long env_steps = 0;
+    double mean_policy_lag = 0.0;  // learner updates between an episode's snapshot and its use
+};
+
+// Run one episode sampling from a pinned logit table. An episode still running after
+// max_steps is truncated, not ended: the learner bootstraps from V at the state it was cut in.
+void run_unroll_impala(const Grid& grid, const TabularParams& logits, ImpalaUnroll& unroll,
+                       Rng& rng, int max_steps = DEFAULT_TIME_LIMIT) {
+    unroll.steps.clear();
+    unroll.bootstrap_state = -1;
+
+    // Random starting state (avoid forbidden areas)
+    int r, c;
+    do {
+        r = rng.uniform_int(ROWS);
+        c = rng.uniform_int(COLS);
+    } while (grid[r][c].type == StateType::Forbidden);
+
+    double total_return = 0.0, gamma_power = 1.0;
+    for (int step = 0; step < max_steps; ++step) {
+        double action_prob;
+        int action = sample_from_logits(logits.row(r, c), rng, &action_prob);
+        auto [next_r, next_c] = next_state(r, c, static_cast<Action>(action), grid);
+        double reward = grid[next_r][next_c].reward;
+        unroll.steps.push(state_index(r, c), action, reward, std::log(action_prob));
+        total_return += gamma_power * reward;
+        gamma_power *= GAMMA;
+
+        if (grid[next_r][next_c].type != StateType::Normal) {
+            unroll.steps.end_episode(total_return);
+            return;
+        }
+        r = next_r;
+        c = next_c;
+    }
+    unroll.bootstrap_state = state_index(r, c);  // cut off: the learner bootstraps from V
+    unroll.steps.end_episode(total_return);
+}
+
+// Learner side: V-trace targets and policy-gradient step over a batch of unrolls
+class VTraceLearner {
+private:
+    TabularParams grad;  // only rows listed in grad_states are non-zero
+    std::vector<int> grad_states;
+    std::vector<uint8_t> grad_touched;
+    std::vector<std::pair<int, double>> value_targets;  // (state, v_s), applied after the batch
+
+public:
+    double lambda;
+
+    explicit VTraceLearner(double lambda = 1.0) : grad(0.0), grad_touched(NUM_STATES, 0), lambda(lambda) {}
+
+    // Backward V-trace recursion for one unroll under the learner's current policy pi:
+    //   rho_t = min(rho_bar, pi/mu), c_t = lambda * min(c_bar, pi/mu)
+    //   v_t   = V(s_t) + rho_t * delta_t + gamma * c_t * (v_{t+1} - V(s_{t+1}))
+    // and the policy-gradient advantage rho_t * (r_t + gamma * v_{t+1} - V(s_t))
+    void accumulate(const ImpalaUnroll& unroll, PPOPolicyNetwork& policy, PPOValueNetwork& value) {
+        const RolloutBuffer& b = unroll.steps;
+        double next_value = unroll.bootstrap_state >= 0 ? value.get_value(unroll.bootstrap_state) : 0.0;
+        double next_vs = next_value;
+        for (size_t t = b.num_steps(); t-- > 0;) {
+            int s = b.states[t];
+            int a = b.actions[t];
+            double v = value.get_value(s);
+            ActionProbs probs = policy.get_action_probs(state_row(s), state_col(s));
+            double ratio = probs[a] / std::exp(b.log_probs[t]);
+            double rho = std::min(VTRACE_RHO_BAR, ratio);
+            double c = lambda * std::min(VTRACE_C_BAR, ratio);
+
+            double delta = rho * (b.rewards[t] + GAMMA * next_value - v);
+            double vs = v + delta + GAMMA * c * (next_vs - next_value);
+            double pg_advantage = rho * (b.rewards[t] + GAMMA * next_vs - v);
+
+            if (!grad_touched[s]) {
+                grad_touched[s] = 1;
+                grad_states.push_back(s);
+            }
+            accumulate_log_softmax_grad(grad.row(s), probs.data(), a, pg_advantage);
+            value_targets.emplace_back(s, vs);
+
+            next_value = v;
+            next_vs = vs;
+        }
+    }
+
+    // Apply the accumulated batch and reset the scratch
+    void apply(PPOPolicyNetwork& policy, PPOValueNetwork& value, double policy_lr, double value_lr) {
+        for (int s : grad_states) {
+            double* g = grad.row(s);
+            policy.step_row(s, g, policy_lr);
+            std::fill_n(g, ACTIONS, 0.0);
+            grad_touched[s] = 0;
+        }
+        grad_states.clear();
+        for (const auto& [s, target] : value_targets) {
+            value.move_toward(s, target, value_lr);
+        }
+        value_targets.clear();
+    }
+};
+
+// IMPALA-style asynchronous training.
+// num_actors threads keep generating episodes with a possibly stale policy snapshot
+// (pinned without locks for the length of one episode, see PolicySnapshots) and
+// hand them to the learner (the calling thread) through a bounded lock-free queue; the
+// learner takes batch_episodes episodes at a time, applies a V-trace corrected update and
+// publishes new parameters. Episode buffers are recycled through a second queue, so the
+// steady state does not allocate. Collection overlaps learning, so unlike the synchronous
+// trainers the result depends on thread timing and is not reproducible run to run.
+// Episodes are cut off after time_limit steps (0 = never) and bootstrapped from the value
+// net. total_steps > 0 sets the training length as an environment-step budget instead of
+// num_episodes: actors stop starting episodes once that many steps have been collected, so
+// at most num_actors episodes in flight run past it.
+void impala(const Grid& grid,
+            std::vector<std::vector<double>>& V,
+            std::vector<std::vector<int>>& policy,
+            int num_episodes = 1500,
+            int batch_episodes = 15,
+            double learning_rate = 0.01,
+            double value_learning_rate = 0.1,
+            int num_actors = 0,
+            uint64_t seed = DEFAULT_SEED,
+            ImpalaStats* stats = nullptr,
+            int time_limit = DEFAULT_TIME_LIMIT,
+            long long total_steps = 0) {
+
+    if (num_actors <= 0) {
+        num_actors = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    }
+    const int max_steps = time_limit > 0 ? time_limit : std::numeric_limits<int>::max();
+
+    PPOPolicyNetwork learner_policy(seed);
+    PPOValueNetwork value_net;
+    VTraceLearner learner;
+    PolicySnapshots snapshots(learner_policy.params(), static_cast<size_t>(num_actors));
+    RngStreams streams(seed);  // One independent stream per episode id
+
+    // Episode buffers circulate between the free and full queues
+    const size_t pool_size = static_cast<size_t>(4 * std::max(batch_episodes, num_actors));
+    std::vector<std::unique_ptr<ImpalaUnroll>> unrolls;
+    BoundedQueue<ImpalaUnroll*> free_queue(pool_size), full_queue(pool_size);
+    for (size_t i = 0; i < pool_size; ++i) {
+        unrolls.push_back(std::make_unique<ImpalaUnroll>());
+        free_queue.try_push(unrolls.back().get());
+    }
+
+    std::atomic<int> next_episode{0};
+    std::atomic<long long> collected_steps{0};
+    std::atomic<int> running_actors{num_actors};
+    std::vector<std::thread> actors;
+    for (int k = 0; k < num_actors; ++k) {
+        actors.emplace_back([&, k] {
+            while (true) {
+                if (total_steps > 0 && collected_steps.load(std::memory_order_relaxed) >= total_steps) break;
+                int episode = next_episode.fetch_add(1, std::memory_order_relaxed);
+                if (total_steps <= 0 && episode >= num_episodes) break;
+
+                ImpalaUnroll* unroll;
+                while (!free_queue.try_pop(unroll)) std::this_thread::yield();
+
+                // Hazard slot k keeps this version alive until the episode is done
+                auto pinned = snapshots.pin(static_cast<size_t>(k));
+                Rng rng = streams.stream(static_cast<uint64_t>(episode));
+                run_unroll_impala(grid, *pinned, *unroll, rng, max_steps);
+                unroll->policy_version = pinned.version();
+                pinned.release();
+                collected_steps.fetch_add(static_cast<long long>(unroll->steps.num_steps()),
+                                          std::memory_order_relaxed);
+                while (!full_queue.try_push(unroll)) std::this_thread::yield();
+            }
+            running_actors.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    // Learner loop: runs until every actor has stopped and the queue is drained
+    int consumed = 0, in_batch = 0, updates = 0;
+    long long env_steps = 0;
+    double total_lag = 0.0;
+    while (true) {
+        // Read before popping: once no actor runs, a failed pop means nothing is left
+        bool actors_done = running_actors.load(std::memory_order_acquire) == 0;
+        ImpalaUnroll* unroll;
+        if (!full_queue.try_pop(unroll)) {
+            if (actors_done) break;
+            std::this_thread::yield();
+            continue;
+        }
+        learner.accumulate(*unroll, learner_policy, value_net);
+        total_lag += static_cast<double>(snapshots.version() - unroll->policy_version);
+        env_steps += static_cast<long long>(unroll->steps.num_steps());
+        free_queue.try_push(unroll);
+        ++consumed;
+
+        if (++in_batch == batch_episodes) {
+            learner.apply(learner_policy, value_net, learning_rate, value_learning_rate);
+            publish_policy(snapshots, learner_policy);
+            ++updates;
+            in_batch = 0;
+        }
+    }
+    if (in_batch > 0) {  // partial last batch
+        learner.apply(learner_policy, value_net, learning_rate, value_learning_rate);
+        ++updates;
+    }
+    for (auto& actor : actors) actor.join();
+
+    if (stats) {
+        stats->episodes = consumed;
+        stats->updates = updates;
+        stats->env_steps = env_steps;
+        stats->mean_policy_lag = consumed > 0 ? total_lag / consumed : 0.0;
+    }
+
+    // Get final optimal policy
+    policy = learner_policy.get_optimal_policy();
+
+    // Get final state values
+    V = value_net.get_values();
+
+    // Update terminal and forbidden state values
+    for (int r = 0; r < ROWS; ++r) {
+        for (int c = 0; c < COLS; ++c) {
+            if (grid[r][c].type != StateType::Normal) {
+                V[r][c] = grid[r][c].reward;
+            }
+        }
+    }
+}
+
+#endif //IMPALA_H
@@ -7,6 +7,7 @@
 #include <vector>
 #include "../env/gridworld.h"
 #include "../env/mdp_config.h"
+#include "compact_tables.h"
 #include <cmath>
 
 /*
@@ -60,4 +61,60 @@ void policy_iteration(const Grid& grid,std::vector<std::vector<double>>& V,std::
     }
 }
 
+/*
+ Compact-storage variant: V is kept as float32 or 16-bit fixed point, the policy is packed at 3 bits per state,
+ and Acc selects the precision used for the Bellman backups. Evaluation stops once the stored values change by
+ no more than THETA or the storage resolution, whichever is larger.
+ */
+template <typename Acc = double, typename Storage>
+void policy_iteration(const Grid& grid,CompactValueTable<Storage>& V,PackedPolicy& policy) {
+    V.fill(0.0);
+    for (int r = 0; r < ROWS; ++r)
+        for (int c = 0; c < COLS; ++c)
+            policy.set(r,c,0);
+
+    bool stable = false;
+    while (!stable) {
+        //---policy evaluation---
+        while (1) {
+            Acc delta = 0;
+            Acc max_abs = 0;
+            for (int r = 0; r < ROWS; ++r) {
+                for (int c = 0; c < COLS; ++c) {
+                    auto [next_r,next_c] = next_state(r,c,static_cast<Action>(policy.get(r,c)),grid);
+                    Acc new_val = static_cast<Acc>(grid[next_r][next_c].reward)
+                                + static_cast<Acc>(GAMMA) * static_cast<Acc>(V.get(next_r,next_c));
+                    Acc old_val = static_cast<Acc>(V.get(r,c));
+                    V.set(r,c,new_val);
+                    delta = std::max(delta,std::fabs(static_cast<Acc>(V.get(r,c)) - old_val));
+                    max_abs = std::max(max_abs,std::fabs(new_val));
+                }
+            }
+            Acc tol = std::max(static_cast<Acc>(THETA),static_cast<Acc>(V.resolution(max_abs)));
+            if (delta <= tol) break;
+        }
+        //---policy improvement---
+        stable = true;
+        for (int r = 0; r < ROWS; ++r) {
+            for (int c = 0; c < COLS; ++c) {
+                int old_a = policy.get(r,c);
+                int best_a = old_a;
+                Acc best_q = static_cast<Acc>(-1e9);
+                for (int a = 0; a < ACTIONS; ++a) {
+                    auto [next_r,next_c] = next_state(r,c,static_cast<Action>(a),grid);
+                    Acc val = static_cast<Acc>(grid[next_r][next_c].reward)
+                            + static_cast<Acc>(GAMMA) * static_cast<Acc>(V.get(next_r,next_c));
+                    if (val > best_q) {
+                        best_q = val;
+                        best_a = a;
+                    }
+                }
+                policy.set(r,c,best_a);
+                if (best_a != old_a)
+                    stable = false;
+            }
+        }
+    }
+}
+
 #endif //POLICY_ITERATION_H
@@ -0,0 +1,276 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef POLICY_TABLE_H
+#define POLICY_TABLE_H
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <limits>
+#include "../env/gridworld.h"
+#include "../utils/rng.h"
+#include "../utils/snapshot.h"
+
+// Doubles per SIMD register / cache line; each state's action row is padded to this width
+constexpr int SIMD_WIDTH = 8;
+constexpr int ACTION_STRIDE = (ACTIONS + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+constexpr size_t TABLE_ALIGNMENT = 64;
+
+// Minimal allocator returning cache-line aligned storage
+template <typename T, size_t Align = TABLE_ALIGNMENT>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+};
+
+// Per-state action distribution, kept on the stack on the rollout hot path.
+// Padded to ACTION_STRIDE like the parameter rows; the padding lanes hold probability 0.
+using ActionProbs = std::array<double, ACTION_STRIDE>;
+
+// Additive lane mask for the row kernels: 0 on the ACTIONS real lanes, -inf on padding
+inline constexpr std::array<double, ACTION_STRIDE> ACTION_LANE_BIAS = [] {
+    std::array<double, ACTION_STRIDE> bias{};
+    for (int a = ACTIONS; a < ACTION_STRIDE; ++a) bias[a] = -std::numeric_limits<double>::infinity();
+    return bias;
+}();
+
+// Contiguous tabular parameter store laid out as [state][action padded to ACTION_STRIDE].
+// Used for policy logits, Q tables and gradient accumulators; padding lanes stay zero.
+class TabularParams {
+private:
+    std::vector<double, AlignedAllocator<double>> data;
+
+public:
+    explicit TabularParams(double init = 0.0) : data(static_cast<size_t>(NUM_STATES) * ACTION_STRIDE, 0.0) {
+        fill(init);
+    }
+
+    double* row(int s) { return data.data() + static_cast<size_t>(s) * ACTION_STRIDE; }
+    const double* row(int s) const { return data.data() + static_cast<size_t>(s) * ACTION_STRIDE; }
+    double* row(int r, int c) { return row(state_index(r, c)); }
+    const double* row(int r, int c) const { return row(state_index(r, c)); }
+
+    double& operator()(int r, int c, int a) { return row(r, c)[a]; }
+    double operator()(int r, int c, int a) const { return row(r, c)[a]; }
+
+    double* raw() { return data.data(); }
+    const double* raw() const { return data.data(); }
+    size_t size() const { return data.size(); }
+
+    void fill(double value) {
+        for (size_t s = 0; s < data.size(); s += ACTION_STRIDE) {
+            std::fill_n(data.data() + s, ACTIONS, value);
+        }
+    }
+
+    // this += alpha * other, one pass over the flat buffer
+    void axpy(double alpha, const TabularParams& other) {
+        double* __restrict dst = data.data();
+        const double* __restrict src = other.data.data();
+        const size_t n = data.size();
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] += alpha * src[i];
+        }
+    }
+
+    void scale(double alpha) {
+        for (double& x : data) x *= alpha;
+    }
+
+    // this = tau * other + (1 - tau) * this
+    void lerp_towards(const TabularParams& other, double tau) {
+        double* __restrict dst = data.data();
+        const double* __restrict src = other.data.data();
+        const size_t n = data.size();
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = tau * src[i] + (1.0 - tau) * dst[i];
+        }
+    }
+};
+
+// Row kernels. Rows are ACTION_STRIDE wide (TabularParams rows, ActionProbs, or local
+// arrays of that size) and every loop runs over the full padded width with a fixed trip
+// count, so the compiler unrolls and vectorizes them over whole registers. Padding lanes
+// are masked by ACTION_LANE_BIAS: they never win a max and get probability exactly 0.
+// std::exp is still a scalar libm call per lane unless the build enables vector math.
+
+// Numerically stable softmax of one action row; the padding lanes of probs are set to 0
+inline void softmax_row(const double* __restrict logits, double* __restrict probs) {
+    alignas(TABLE_ALIGNMENT) double x[ACTION_STRIDE];
+    double max_logit = -std::numeric_limits<double>::infinity();
+    for (int a = 0; a < ACTION_STRIDE; ++a) {
+        x[a] = logits[a] + ACTION_LANE_BIAS[a];
+        max_logit = std::max(max_logit, x[a]);
+    }
+    double sum_exp = 0.0;
+    for (int a = 0; a < ACTION_STRIDE; ++a) {
+        probs[a] = std::exp(x[a] - max_logit);
+        sum_exp += probs[a];
+    }
+    double inv_sum = 1.0 / sum_exp;
+    for (int a = 0; a < ACTION_STRIDE; ++a) {
+        probs[a] *= inv_sum;
+    }
+}
+
+// Draw an action index from a probability row by inverse-CDF sampling (no allocation)
+inline int sample_from_probs(const double* probs, Rng& rng) {
+    double u = rng.uniform01();
+    double cdf = 0.0;
+    for (int a = 0; a < ACTIONS - 1; ++a) {
+        cdf += probs[a];
+        if (u < cdf) return a;
+    }
+    return ACTIONS - 1;  // also absorbs rounding when the cdf ends just below 1
+}
+
+// Index of the first largest real lane
+inline int argmax_row(const double* values) {
+    int best = 0;
+    double best_value = -std::numeric_limits<double>::infinity();
+    for (int a = 0; a < ACTION_STRIDE; ++a) {
+        double v = values[a] + ACTION_LANE_BIAS[a];
+        if (v > best_value) {
+            best_value = v;
+            best = a;
+        }
+    }
+    return best;
+}
+
+// Per-state memo. Stamps are compared against a version counter, so dropping
+// every entry is O(1) and a single entry can be dropped on its own.
+template <typename T>
+class StateCache {
+private:
+    std::vector<T> values;
+    std::vector<uint64_t> stamps;
+    uint64_t version = 1;
+
+public:
+    StateCache() : values(NUM_STATES), stamps(NUM_STATES, 0) {}
+
+    bool valid(int s) const { return stamps[s] == version; }
+    T& slot(int s) { return values[s]; }
+    const T& slot(int s) const { return values[s]; }
+    void validate(int s) { stamps[s] = version; }
+    void invalidate(int s) { stamps[s] = 0; }
+    void invalidate_all() { ++version; }
+};
+
+// Softmax policy over a TabularParams logit table with a cached probability row per state.
+// Every write goes through this class so the cache can never serve a stale row.
+// probs() fills the cache lazily, so it is not safe to call from several threads unless
+// refresh() ran after the last write; refresh() only recomputes the rows written since.
+class SoftmaxPolicy {
+private:
+    TabularParams logits;
+    mutable StateCache<ActionProbs> cache;
+    mutable std::vector<int> stale_rows;  // rows dropped by mutable_row since the last refresh()
+    mutable bool all_stale = true;        // set by whole-table writes
+
+public:
+    explicit SoftmaxPolicy(double init = 0.0) : logits(init) {}
+
+    // Cached action distribution of state s
+    const ActionProbs& probs(int s) const {
+        if (!cache.valid(s)) {
+            softmax_row(logits.row(s), cache.slot(s).data());
+            cache.validate(s);
+        }
+        return cache.slot(s);
+    }
+    const ActionProbs& probs(int r, int c) const { return probs(state_index(r, c)); }
+
+    const double* row(int s) const { return logits.row(s); }
+    const double* row(int r, int c) const { return logits.row(r, c); }
+    const TabularParams& params() const { return logits; }
+    int argmax(int r, int c) const { return argmax_row(logits.row(r, c)); }
+
+    // Writable logit row; drops the cached distribution of this state only
+    double* mutable_row(int s) {
+        if (cache.valid(s)) {
+            cache.invalidate(s);
+            stale_rows.push_back(s);
+        }
+        return logits.row(s);
+    }
+    double* mutable_row(int r, int c) { return mutable_row(state_index(r, c)); }
+
+    void axpy(double alpha, const TabularParams& delta) {
+        logits.axpy(alpha, delta);
+        cache.invalidate_all();
+        all_stale = true;
+    }
+
+    void assign(const TabularParams& params) {
+        logits = params;
+        cache.invalidate_all();
+        all_stale = true;
+    }
+
+    // Bring every cached row up to date so concurrent readers never write the cache
+    void refresh() const {
+        if (all_stale) {
+            for (int s = 0; s < NUM_STATES; ++s) probs(s);
+        } else {
+            for (int s : stale_rows) probs(s);
+        }
+        stale_rows.clear();
+        all_stale = false;
+    }
+};
+
+// Published versions of a policy's logit table, used by impala(): its actors pin a
+// version per episode and sample straight from it without locks or copies, while the
+// synchronous trainers sample from their own SoftmaxPolicy and need none of this.
+// Every policy class exposes its table through params().
+using PolicySnapshots = SnapshotPublisher<TabularParams>;
+
+// Copies the learner's table into a recycled snapshot buffer (no allocation once warm)
+// and makes it the current version
+template <typename PolicyNet>
+void publish_policy(PolicySnapshots& snapshots, const PolicyNet& net) {
+    snapshots.publish(net.params());
+}
+
+// Sample from an uncached logit row (for readers of a pinned snapshot); optionally
+// reports the probability of the chosen action
+inline int sample_from_logits(const double* logits, Rng& rng, double* action_prob = nullptr) {
+    ActionProbs probs;
+    softmax_row(logits, probs.data());
+    int action = sample_from_probs(probs.data(), rng);
+    if (action_prob) *action_prob = probs[action];
+    return action;
+}
+
+// grad_row += weight * d log pi(action) / d logits = weight * (onehot(action) - probs);
+// padding lanes of probs are 0, so those of grad_row are left unchanged
+inline void accumulate_log_softmax_grad(double* __restrict grad_row, const double* __restrict probs,
+                                        int action, double weight) {
+    for (int a = 0; a < ACTION_STRIDE; ++a) {
+        grad_row[a] -= weight * probs[a];
+    }
+    grad_row[action] += weight;
+}
+
+#endif //POLICY_TABLE_H
@@ -6,150 +6,170 @@
 #define PPO_H
 
 #include <vector>
-#include <random>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
 #include "../env/gridworld.h"
 #include "../env/mdp_config.h"
+#include "policy_table.h"
+#include "step_buffer.h"
+#include "../utils/rng.h"
+#include "../utils/thread_pool.h"
 
-// Trajectory structure for PPO
-struct PPOTrajectory {
-    std::vector<std::pair<int, int>> states;  // State sequence (r, c)
-    std::vector<int> actions;                 // Action sequence
-    std::vector<double> rewards;              // Reward sequence
-    std::vector<double> old_action_probs;     // Old action probabilities
-    std::vector<double> advantages;           // Advantage estimates
-    double total_return;                      // Total discounted return
+// Fused per-sample PPO kernel. With ratio = exp(logp - old_logp), the clipped objective
+// min(ratio * A, clip(ratio) * A) has gradient A * ratio * (onehot(action) - probs) unless the
+// clip is active (ratio above 1 + epsilon with A > 0, or below 1 - epsilon with A < 0).
+// Accumulates into grad_row and returns the ratio.
+inline double accumulate_ppo_clip_grad(double* grad_row, const double* probs, int action,
+                                       double old_log_prob, double advantage, double epsilon) {
+    double log_prob = std::log(std::max(probs[action], 1e-300));
+    double ratio = std::exp(log_prob - old_log_prob);
+    bool clipped = advantage >= 0.0 ? ratio > 1.0 + epsilon : ratio < 1.0 - epsilon;
+    if (!clipped) {
+        accumulate_log_softmax_grad(grad_row, probs, action, advantage * ratio);
+    }
+    return ratio;
+}
+
+// Default early-stopping threshold on the per-epoch approximate KL (0 disables it)
+constexpr double DEFAULT_TARGET_KL = 0.02;
+
+// Default GAE(lambda) trace decay
+constexpr double DEFAULT_GAE_LAMBDA = 0.95;
+
+// Telemetry of one policy update
+struct PPOUpdateStats {
+    int epochs = 0;              // epochs actually run
+    double approx_kl = 0.0;      // approximate KL(old || new) measured in the last epoch
+    double clip_fraction = 0.0;  // fraction of samples whose ratio left [1 - epsilon, 1 + epsilon]
+};
+
+// Per-epoch sums for PPOUpdateStats. KL uses the non-negative estimator
+// (ratio - 1) - log(ratio) of KL(old || new), which is exact in expectation under the old policy.
+struct PPOEpochAccumulator {
+    double kl = 0.0, clipped = 0.0, n = 0.0;
+    
+    void add(double ratio, double epsilon, double weight = 1.0) {
+        kl += weight * ((ratio - 1.0) - std::log(std::max(ratio, 1e-300)));
+        if (std::fabs(ratio - 1.0) > epsilon) clipped += weight;
+        n += weight;
+    }
+    
+    // Record the finished epoch; true when the update should stop
+    bool finish_epoch(PPOUpdateStats& stats, double target_kl) const {
+        ++stats.epochs;
+        stats.approx_kl = n > 0.0 ? kl / n : 0.0;
+        stats.clip_fraction = n > 0.0 ? clipped / n : 0.0;
+        return target_kl > 0.0 && stats.approx_kl > target_kl;
+    }
 };
 
 // Policy network for PPO
 class PPOPolicyNetwork {
 private:
-    std::vector<std::vector<std::vector<double>>> theta;  // Policy parameters [state_r][state_c][action]
-    std::mt19937 rng;  // Random number generator
+    SoftmaxPolicy theta;  // Policy parameters [state][action] with cached probabilities
+    Rng rng;  // Random number generator for the convenience overloads and minibatch shuffles
+    
+    // Minibatch scratch, reused across updates
+    TabularParams minibatch_grad;      // only rows listed in grad_states are non-zero
+    std::vector<int> grad_states;
+    std::vector<uint8_t> grad_touched;
+    std::vector<uint32_t> order;       // sample permutation of the current epoch
     
 public:
-    PPOPolicyNetwork() : rng(std::random_device{}()) {
-        // Initialize policy parameters
-        theta.assign(ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-    }
+    explicit PPOPolicyNetwork(uint64_t seed = DEFAULT_SEED)
+        : theta(0.0), rng(seed), minibatch_grad(0.0), grad_touched(NUM_STATES, 0) {}
     
     // Get action probability distribution
-    std::vector<double> get_action_probs(int r, int c) {
-        std::vector<double> logits = theta[r][c];
-        std::vector<double> probs(ACTIONS);
-        
-        // Compute softmax with numerical stability
-        double max_logit = *std::max_element(logits.begin(), logits.end());
-        double sum_exp = 0.0;
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] = std::exp(logits[a] - max_logit);
-            sum_exp += probs[a];
-        }
-        
-        // Normalize
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] /= sum_exp;
-        }
-        
-        return probs;
+    ActionProbs get_action_probs(int r, int c) {
+        return theta.probs(r, c);
     }
     
-    // Sample action according to policy
-    int sample_action(int r, int c) {
-        std::vector<double> probs = get_action_probs(r, c);
-        std::discrete_distribution<int> dist(probs.begin(), probs.end());
-        return dist(rng);
+    // Sample action according to policy; optionally report its probability from the same softmax
+    int sample_action(int r, int c, Rng& gen, double* action_prob = nullptr) {
+        const ActionProbs& probs = theta.probs(r, c);
+        int action = sample_from_probs(probs.data(), gen);
+        if (action_prob) *action_prob = probs[action];
+        return action;
     }
     
+    int sample_action(int r, int c, double* action_prob = nullptr) {
+        return sample_action(r, c, rng, action_prob);
+    }
+    
+    // Network-owned random stream
+    Rng& generator() { return rng; }
+    
+    // Call before parallel rollouts: refreshes the probability cache so threads only read the policy
+    void prepare_rollouts() const { theta.refresh(); }
+    
     // Get action probability
     double get_action_prob(int r, int c, int action) {
-        std::vector<double> probs = get_action_probs(r, c);
-        return probs[action];
+        return theta.probs(r, c)[action];
     }
     
-    // Compute PPO loss with clipping
-    double compute_ppo_loss(const std::vector<PPOTrajectory>& trajectories, 
-                           double epsilon = 0.2) {
-        
-        double total_loss = 0.0;
-        int total_samples = 0;
-        
-        for (const auto& traj : trajectories) {
-            for (size_t t = 0; t < traj.states.size(); ++t) {
-                int r = traj.states[t].first;
-                int c = traj.states[t].second;
-                int action = traj.actions[t];
-                
-                double old_prob = traj.old_action_probs[t];
-                double new_prob = get_action_prob(r, c, action);
-                double advantage = traj.advantages[t];
-                
-                // Compute probability ratio
-                double ratio = new_prob / (old_prob + 1e-8);
-                
-                // Clipped surrogate objective
-                double clipped_ratio = std::clamp(ratio, 1.0 - epsilon, 1.0 + epsilon);
-                double surrogate_loss = -std::min(ratio * advantage, clipped_ratio * advantage);
-                
-                total_loss += surrogate_loss;
-                total_samples++;
-            }
+    // Raw logit table (for published snapshots)
+    const TabularParams& params() const { return theta.params(); }
+    
+    // row(s) += scale * delta, for learners that accumulate their own gradients
+    void step_row(int s, const double* delta, double scale) {
+        double* row = theta.mutable_row(s);
+        for (int a = 0; a < ACTIONS; ++a) {
+            row[a] += scale * delta[a];
         }
-        
-        return total_samples > 0 ? total_loss / total_samples : 0.0;
     }
     
-    // Update policy using PPO
-    void update_policy_ppo(const std::vector<PPOTrajectory>& trajectories, 
-                          double learning_rate = 0.001,
-                          double epsilon = 0.2,
-                          int num_epochs = 10) {
+    // Standard PPO update over a flattened T x N buffer: every epoch shuffles the sample
+    // indices and steps the policy once per minibatch. Each sample runs the fused
+    // ratio/clip/gradient kernel on its state's cached probabilities; rows only change
+    // between minibatches, so the cache holds within one. The kernel's ratios also give
+    // the epoch's approximate KL and clip fraction; epochs stop once KL exceeds target_kl.
+    PPOUpdateStats update_policy_minibatch(const StepBuffer& buffer,
+                                           double learning_rate = 0.001,
+                                           double epsilon = 0.2,
+                                           int num_epochs = 10,
+                                           int num_minibatches = 4,
+                                           double target_kl = DEFAULT_TARGET_KL) {
+        PPOUpdateStats result;
+        const size_t n = buffer.size();
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0u);
+        const size_t minibatches = std::clamp<size_t>(static_cast<size_t>(num_minibatches), 1, std::max<size_t>(n, 1));
         
         for (int epoch = 0; epoch < num_epochs; ++epoch) {
-            // Compute gradients for PPO loss
-            std::vector<std::vector<std::vector<double>>> gradients(
-                ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
+            shuffle_in_place(order, rng);
+            PPOEpochAccumulator acc;
             
-            for (const auto& traj : trajectories) {
-                for (size_t t = 0; t < traj.states.size(); ++t) {
-                    int r = traj.states[t].first;
-                    int c = traj.states[t].second;
-                    int action = traj.actions[t];
-                    
-                    double old_prob = traj.old_action_probs[t];
-                    double new_prob = get_action_prob(r, c, action);
-                    double advantage = traj.advantages[t];
-                    
-                    // Compute probability ratio
-                    double ratio = new_prob / (old_prob + 1e-8);
-                    
-                    // Clipped surrogate gradient
-                    double clipped_ratio = std::clamp(ratio, 1.0 - epsilon, 1.0 + epsilon);
-                    double gradient_scale = (ratio <= clipped_ratio) ? 1.0 : 0.0;
-                    
-                    // Compute policy gradient
-                    std::vector<double> probs = get_action_probs(r, c);
-                    for (int a = 0; a < ACTIONS; ++a) {
-                        if (a == action) {
-                            gradients[r][c][a] += gradient_scale * (1.0 - probs[a]) * advantage;
-                        } else {
-                            gradients[r][c][a] += gradient_scale * (-probs[a]) * advantage;
-                        }
+            for (size_t mb = 0; mb < minibatches; ++mb) {
+                for (size_t k = n * mb / minibatches; k < n * (mb + 1) / minibatches; ++k) {
+                    size_t i = order[k];
+                    int s = buffer.states[i];
+                    if (!grad_touched[s]) {
+                        grad_touched[s] = 1;
+                        grad_states.push_back(s);
                     }
+                    double ratio = accumulate_ppo_clip_grad(minibatch_grad.row(s), theta.probs(s).data(),
+                                                            buffer.actions[i], buffer.log_probs[i],
+                                                            buffer.advantages[i], epsilon);
+                    acc.add(ratio, epsilon);
                 }
-            }
-            
-            // Update parameters
-            for (int r = 0; r < ROWS; ++r) {
-                for (int c = 0; c < COLS; ++c) {
+                
+                // Apply and clear the minibatch gradient of the visited rows only
+                for (int s : grad_states) {
+                    double* row = theta.mutable_row(s);
+                    double* grad = minibatch_grad.row(s);
                     for (int a = 0; a < ACTIONS; ++a) {
-                        theta[r][c][a] += learning_rate * gradients[r][c][a];
+                        row[a] += learning_rate * grad[a];
+                        grad[a] = 0.0;
                     }
+                    grad_touched[s] = 0;
                 }
+                grad_states.clear();
             }
+            
+            if (acc.finish_epoch(result, target_kl)) break;
         }
+        return result;
     }
     
     // Get optimal policy
@@ -157,8 +177,7 @@ public:
         std::vector<std::vector<int>> policy(ROWS, std::vector<int>(COLS));
         for (int r = 0; r < ROWS; ++r) {
             for (int c = 0; c < COLS; ++c) {
-                std::vector<double> probs = get_action_probs(r, c);
-                policy[r][c] = std::max_element(probs.begin(), probs.end()) - probs.begin();
+                policy[r][c] = theta.argmax(r, c);
             }
         }
         return policy;
@@ -179,18 +198,19 @@ public:
     double get_value(int r, int c) {
         return V[r][c];
     }
+    double get_value(int s) { return V[state_row(s)][state_col(s)]; }
     
-    // Update value function using Monte Carlo returns
-    void update_values(const std::vector<PPOTrajectory>& trajectories, double learning_rate = 0.001) {
-        for (const auto& traj : trajectories) {
-            double return_t = traj.total_return;
-            for (size_t t = 0; t < traj.states.size(); ++t) {
-                int r = traj.states[t].first;
-                int c = traj.states[t].second;
-                
-                // Simple Monte Carlo update
-                V[r][c] += learning_rate * (return_t - V[r][c]);
-            }
+    // One regression step of V(s) toward target
+    void move_toward(int s, double target, double learning_rate) {
+        double& v = V[state_row(s)][state_col(s)];
+        v += learning_rate * (target - v);
+    }
+    
+    // Regress every visited state toward its per-step return target
+    void update_values(const StepBuffer& buffer, double learning_rate = 0.001) {
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            double& v = V[state_row(buffer.states[i])][state_col(buffer.states[i])];
+            v += learning_rate * (buffer.returns[i] - v);
         }
     }
     
@@ -200,104 +220,96 @@ public:
     }
 };
 
-// Run episode and return trajectory
-PPOTrajectory run_episode_ppo(const Grid& grid, PPOPolicyNetwork& policy_net, 
-                             PPOValueNetwork& value_net, int max_steps = 1000) {
-    PPOTrajectory traj;
-    traj.total_return = 0.0;
-    
-    // Random starting state (avoid forbidden areas)
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<int> dist_r(0, ROWS - 1);
-    std::uniform_int_distribution<int> dist_c(0, COLS - 1);
-    
-    int r, c;
-    do {
-        r = dist_r(rng);
-        c = dist_c(rng);
-    } while (grid[r][c].type == StateType::Forbidden);
-    
-    double gamma_power = 1.0;  // gamma^t
-    
-    for (int step = 0; step < max_steps; ++step) {
-        // Record current state
-        traj.states.emplace_back(r, c);
-        
-        // Sample action
-        int action = policy_net.sample_action(r, c);
-        traj.actions.push_back(action);
-        
-        // Record old action probability
-        double action_prob = policy_net.get_action_prob(r, c, action);
-        traj.old_action_probs.push_back(action_prob);
-        
-        // Execute action
-        auto [next_r, next_c] = next_state(r, c, static_cast<Action>(action), grid);
-        
-        // Get reward
-        double reward = grid[next_r][next_c].reward;
-        traj.rewards.push_back(reward);
-        
-        // Accumulate discounted return
-        traj.total_return += gamma_power * reward;
-        gamma_power *= GAMMA;
-        
-        // Check if reached terminal state
-        if (grid[next_r][next_c].type == StateType::Terminal) {
-            break;
-        }
-        
-        // Check if entered forbidden area
-        if (grid[next_r][next_c].type == StateType::Forbidden) {
-            break;
+// Step every environment buffer.horizon() times into the buffer, recording behaviour
+// log-probabilities and values, then the bootstrap value of each unfinished episode
+// (including episodes cut off by the environments' time limit).
+// Environments are spread over the pool; each writes only its own column and draws
+// only from its own stream, so the buffer does not depend on the thread count.
+// The policy cache must be fresh (prepare_rollouts) since the policy is read concurrently.
+void collect_steps_ppo(PPOPolicyNetwork& policy_net, PPOValueNetwork& value_net,
+                       VecGridEnv& envs, StepBuffer& buffer,
+                       ThreadPool& pool = default_thread_pool()) {
+    pool.parallel_for(envs.num_envs(), [&](size_t, size_t first, size_t last) {
+        for (size_t env = first; env < last; ++env) {
+            Rng& rng = envs.rng(env);
+            for (size_t t = 0; t < buffer.horizon(); ++t) {
+                size_t i = buffer.index(t, env);
+                int s = envs.state(env);
+                int r = state_row(s), c = state_col(s);
+                
+                double action_prob;
+                int action = policy_net.sample_action(r, c, rng, &action_prob);
+                bool done, truncated;
+                int cut_state;
+                double reward = envs.step(env, action, done, truncated, cut_state);
+                if (truncated) {
+                    // Time limit: end the trace here but bootstrap from V(s'), see StepBuffer
+                    reward += GAMMA * value_net.get_value(state_row(cut_state), state_col(cut_state));
+                    done = true;
+                }
+                
+                buffer.states[i] = s;
+                buffer.actions[i] = static_cast<uint8_t>(action);
+                buffer.rewards[i] = reward;
+                buffer.log_probs[i] = std::log(action_prob);
+                buffer.dones[i] = done;
+                buffer.values[i] = value_net.get_value(r, c);
+            }
+            int s = envs.state(env);
+            buffer.bootstrap_values[env] = value_net.get_value(state_row(s), state_col(s));
         }
-        
-        r = next_r;
-        c = next_c;
-    }
-    
-    // Compute advantages (Monte Carlo advantage)
-    traj.advantages.resize(traj.states.size());
-    double advantage = traj.total_return;
-    for (size_t t = 0; t < traj.states.size(); ++t) {
-        int r = traj.states[t].first;
-        int c = traj.states[t].second;
-        double value = value_net.get_value(r, c);
-        traj.advantages[t] = advantage - value;
-        advantage -= traj.rewards[t];
-    }
-    
-    return traj;
+    });
 }
 
-// PPO main function
+// PPO main function.
+// num_envs environments run in lockstep and their episodes carry over between updates;
+// every update collects horizon steps from each of them (num_envs * horizon environment
+// steps), estimates GAE(gae_lambda) advantages and value targets, and runs num_epochs
+// passes of num_minibatches shuffled minibatches, stopping its epochs early once the
+// approximate KL exceeds target_kl. update_log, if given, receives every update's stats.
+// Episodes are cut off after time_limit steps (0 = never) and bootstrapped from the value
+// net. total_steps > 0 replaces num_updates with an environment-step budget:
+// ceil(total_steps / (horizon * num_envs)) updates.
 void ppo(const Grid& grid, 
          std::vector<std::vector<double>>& V, 
          std::vector<std::vector<int>>& policy,
-         int num_episodes = 1000,
-         int episodes_per_update = 20,
+         int num_updates = 50,
+         int num_envs = 20,
          double learning_rate = 0.001,
-         double epsilon = 0.2) {
+         double epsilon = 0.2,
+         uint64_t seed = DEFAULT_SEED,
+         int horizon = 64,
+         int num_epochs = 10,
+         int num_minibatches = 4,
+         double gae_lambda = DEFAULT_GAE_LAMBDA,
+         double target_kl = DEFAULT_TARGET_KL,
+         std::vector<PPOUpdateStats>* update_log = nullptr,
+         int time_limit = DEFAULT_TIME_LIMIT,
+         long long total_steps = 0) {
     
-    PPOPolicyNetwork policy_net;
+    PPOPolicyNetwork policy_net(seed);
+    RngStreams streams(seed);  // One independent stream per environment for reproducible runs
     PPOValueNetwork value_net;
-    std::vector<PPOTrajectory> trajectories;
+    VecGridEnv envs(grid, num_envs, streams, time_limit);  // Episodes carry over between updates
+    StepBuffer buffer(horizon, num_envs);                  // Fixed size, overwritten every update
     
-    for (int episode = 0; episode < num_episodes; ++episode) {
-        // Run episode
-        PPOTrajectory traj = run_episode_ppo(grid, policy_net, value_net);
-        trajectories.push_back(traj);
+    if (total_steps > 0) {
+        long long steps_per_update = static_cast<long long>(buffer.size());
+        num_updates = static_cast<int>((total_steps + steps_per_update - 1) / steps_per_update);
+    }
+    for (int update = 0; update < num_updates; ++update) {
+        // Collect one T x N rollout in parallel; policy and value tables are read-only meanwhile
+        policy_net.prepare_rollouts();
+        collect_steps_ppo(policy_net, value_net, envs, buffer);
+        buffer.compute_gae(GAMMA, gae_lambda);
         
-        // Update policy and value function every few episodes
-        if ((episode + 1) % episodes_per_update == 0) {
-            // Update value function
-            value_net.update_values(trajectories, learning_rate);
-            
-            // Update policy using PPO
-            policy_net.update_policy_ppo(trajectories, learning_rate, epsilon);
-            
-            trajectories.clear();
-        }
+        // Update value function toward the GAE targets
+        value_net.update_values(buffer, learning_rate);
+        
+        // Update policy using minibatch PPO
+        PPOUpdateStats stats = policy_net.update_policy_minibatch(buffer, learning_rate, epsilon, num_epochs,
+                                                                  num_minibatches, target_kl);
+        if (update_log) update_log->push_back(stats);
     }
     
     // Get final optimal policy
@@ -0,0 +1,121 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef PRIORITIZED_REPLAY_H
+#define PRIORITIZED_REPLAY_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "replay_buffer.h"
+#include "../utils/rng.h"
+
+// Binary sum tree over a fixed number of leaves, stored as a flat array:
+// node i has children 2i and 2i + 1, leaves start at index `leaves`.
+// Setting a leaf and finding the leaf that covers a prefix sum are both O(log N).
+class SumTree {
+private:
+    size_t leaves = 1;          // power of two >= capacity
+    std::vector<double> nodes;  // nodes[1] is the root; nodes[0] is unused
+
+public:
+    explicit SumTree(size_t capacity) {
+        while (leaves < capacity) leaves *= 2;
+        nodes.assign(2 * leaves, 0.0);
+    }
+
+    double total() const { return nodes[1]; }
+    double get(size_t i) const { return nodes[leaves + i]; }
+
+    void set(size_t i, double priority) {
+        size_t node = leaves + i;
+        nodes[node] = priority;
+        for (node /= 2; node >= 1; node /= 2) {
+            nodes[node] = nodes[2 * node] + nodes[2 * node + 1];
+        }
+    }
+
+    // Leaf whose cumulative range contains prefix (0 <= prefix < total())
+    size_t find(double prefix) const {
+        size_t node = 1;
+        while (node < leaves) {
+            size_t left = 2 * node;
+            if (prefix < nodes[left] || nodes[left + 1] == 0.0) {
+                node = left;
+            } else {
+                prefix -= nodes[left];
+                node = left + 1;
+            }
+        }
+        return node - leaves;
+    }
+};
+
+// Prioritized experience replay (Schaul et al.) over the SoA replay ring.
+// Slot i is sampled with probability p_i^alpha / sum_j p_j^alpha, where p_i is the last
+// |TD error| reported for it (new transitions get the largest priority seen so far, so
+// each is replayed at least once soon). Importance-sampling weights (N * P(i))^-beta,
+// normalised by the batch maximum, correct the bias that non-uniform sampling introduces.
+// Unlike the ring's uniform sampling this mode keeps a non-atomic tree, so pushes,
+// samples and priority updates must come from one thread.
+class PrioritizedReplay {
+private:
+    ReplayBuffer ring;
+    SumTree tree;
+    double alpha;
+    double max_priority = 1.0;  // largest priority ever assigned (before the alpha power)
+
+    static constexpr double PRIORITY_EPS = 1e-6;  // keeps zero-error transitions sampleable
+
+public:
+    explicit PrioritizedReplay(size_t capacity = 10000, double alpha = 0.6)
+        : ring(capacity), tree(capacity), alpha(alpha) {}
+
+    void push(int state, int action, double reward, int next_state, bool done) {
+        uint32_t slot = ring.push(state, action, reward, next_state, done);
+        tree.set(slot, std::pow(max_priority, alpha));
+    }
+
+    size_t size() const { return ring.size(); }
+    const ReplayBuffer& buffer() const { return ring; }
+    Transition load(uint32_t slot) const { return ring.load(slot); }
+
+    // Stratified sampling: the priority mass is cut into batch_size equal segments and
+    // one slot is drawn from each, which lowers the variance of a batch versus i.i.d. draws.
+    // Fills slot indices and importance-sampling weights (max weight in the batch is 1).
+    void sample(size_t batch_size, double beta, Rng& rng,
+                std::vector<uint32_t>& indices, std::vector<double>& weights) const {
+        size_t n = size();
+        batch_size = std::min(batch_size, n);
+        indices.resize(batch_size);
+        weights.resize(batch_size);
+        if (batch_size == 0) return;
+
+        double total = tree.total();
+        double segment = total / static_cast<double>(batch_size);
+        double max_weight = 0.0;
+        for (size_t k = 0; k < batch_size; ++k) {
+            double prefix = std::min((static_cast<double>(k) + rng.uniform01()) * segment, std::nextafter(total, 0.0));
+            size_t slot = std::min(tree.find(prefix), n - 1);
+            indices[k] = static_cast<uint32_t>(slot);
+            double prob = tree.get(slot) / total;
+            weights[k] = std::pow(static_cast<double>(n) * prob, -beta);
+            max_weight = std::max(max_weight, weights[k]);
+        }
+        for (double& w : weights) w /= max_weight;
+    }
+
+    // New priorities from the TD errors of a sampled batch
+    void update_priorities(const std::vector<uint32_t>& indices, const std::vector<double>& td_errors) {
+        for (size_t k = 0; k < indices.size(); ++k) {
+            double priority = std::fabs(td_errors[k]) + PRIORITY_EPS;
+            max_priority = std::max(max_priority, priority);
+            tree.set(indices[k], std::pow(priority, alpha));
+        }
+    }
+};
+
+#endif //PRIORITIZED_REPLAY_H
@@ -6,11 +6,16 @@
 #define REINFORCE_H
 
 #include <vector>
-#include <random>
 #include <cmath>
 #include <algorithm>
 #include "../env/gridworld.h"
 #include "../env/mdp_config.h"
+#include "policy_table.h"
+#include "batch_stats.h"
+#include "rollout_buffer.h"
+#include "run_length_buffer.h"
+#include "rollout_engine.h"
+#include "../utils/rng.h"
 
 // 经验回放缓冲区中的轨迹结构
 struct Trajectory {
@@ -23,80 +28,85 @@ struct Trajectory {
 // 策略网络（简单的线性策略）
 class PolicyNetwork {
 private:
-    std::vector<std::vector<std::vector<double>>> theta;  // 策略参数 [state_r][state_c][action]
-    std::mt19937 rng;  // 随机数生成器
+    SoftmaxPolicy theta;  // 策略参数 [state][action]，连续存储，带概率缓存
+    BatchStats batch;  // 批量轨迹压缩后的(state, action)统计量，跨更新复用
+    ParallelBatchCompressor compressor;  // 多线程分块压缩 + 固定顺序树形归约
+    Rng rng;  // 随机数生成器（仅供不传入rng的便捷接口使用）
     
 public:
-    PolicyNetwork() : rng(std::random_device{}()) {
-        // 初始化策略参数，每个状态-动作对的logit
-        theta.assign(ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-    }
+    explicit PolicyNetwork(uint64_t seed = DEFAULT_SEED) : theta(0.0), rng(seed) {}
     
     // 获取动作概率分布
-    std::vector<double> get_action_probs(int r, int c) {
-        std::vector<double> logits = theta[r][c];
-        std::vector<double> probs(ACTIONS);
-        
-        // 计算softmax
-        double max_logit = *std::max_element(logits.begin(), logits.end());
-        double sum_exp = 0.0;
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] = std::exp(logits[a] - max_logit);
-            sum_exp += probs[a];
-        }
-        
-        // 归一化
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] /= sum_exp;
-        }
-        
-        return probs;
+    ActionProbs get_action_probs(int r, int c) {
+        return theta.probs(r, c);
+    }
+    
+    // 根据策略采样动作；action_prob非空时顺带返回该动作的概率（与采样共用一次softmax）
+    int sample_action(int r, int c, Rng& gen, double* action_prob = nullptr) {
+        const ActionProbs& probs = theta.probs(r, c);
+        int action = sample_from_probs(probs.data(), gen);
+        if (action_prob) *action_prob = probs[action];
+        return action;
     }
     
-    // 根据策略采样动作
-    int sample_action(int r, int c) {
-        std::vector<double> probs = get_action_probs(r, c);
-        std::discrete_distribution<int> dist(probs.begin(), probs.end());
-        return dist(rng);
+    int sample_action(int r, int c, double* action_prob = nullptr) {
+        return sample_action(r, c, rng, action_prob);
     }
     
+    // 网络自带的随机数流
+    Rng& generator() { return rng; }
+    
+    // 并行采样前调用：刷新概率缓存，之后多个线程只读策略
+    void prepare_rollouts() const { theta.refresh(); }
+    
+    // 策略参数表（用于发布快照）
+    const TabularParams& params() const { return theta.params(); }
+    
     // 获取动作概率
     double get_action_prob(int r, int c, int action) {
-        std::vector<double> probs = get_action_probs(r, c);
-        return probs[action];
+        return theta.probs(r, c)[action];
     }
     
-    // 更新策略参数
+    // 更新策略参数：先把整批轨迹压缩为(state, action)充分统计量，再按统计量更新
     void update_theta(const std::vector<Trajectory>& trajectories, double learning_rate) {
-        // 计算每个状态-动作对的梯度
-        std::vector<std::vector<std::vector<double>>> gradients(
-            ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-        
+        batch.clear();
         for (const auto& traj : trajectories) {
             for (size_t t = 0; t < traj.states.size(); ++t) {
-                int r = traj.states[t].first;
-                int c = traj.states[t].second;
-                int action = traj.actions[t];
-                
-                // 计算策略梯度
-                std::vector<double> probs = get_action_probs(r, c);
-                for (int a = 0; a < ACTIONS; ++a) {
-                    if (a == action) {
-                        gradients[r][c][a] += (1.0 - probs[a]) * traj.total_return;
-                    } else {
-                        gradients[r][c][a] += (-probs[a]) * traj.total_return;
-                    }
-                }
+                int s = state_index(traj.states[t].first, traj.states[t].second);
+                batch.add(s, traj.actions[t], traj.total_return);
             }
         }
-        
-        // 更新参数
-        for (int r = 0; r < ROWS; ++r) {
-            for (int c = 0; c < COLS; ++c) {
-                for (int a = 0; a < ACTIONS; ++a) {
-                    theta[r][c][a] += learning_rate * gradients[r][c][a];
+        update_theta(batch, learning_rate);
+    }
+    
+    // 直接从游程编码缓冲区压缩：一个游程内的L步(s,a)相同、权重都是所在episode的回报，按n=L一次计入，
+    // 代价与游程数成正比；按固定分块多线程压缩，结果与线程数无关
+    void update_theta(const RunLengthBuffer& buffer, double learning_rate) {
+        compressor.compress(batch, buffer.num_runs(), [&](BatchStats& out, size_t begin, size_t end) {
+            for (size_t i = begin, e = buffer.episode_of(begin); i < end; ++i) {
+                while (i >= buffer.episode_end(e)) ++e;
+                out.add(buffer.states[i], buffer.actions[i], buffer.returns[e], 0.0, buffer.lengths[i]);
+            }
+        });
+        update_theta(batch, learning_rate);
+    }
+    
+    // 梯度对每个(s,a)的回报之和是线性的：grad[s] = sum_a W(s,a) * (onehot(a) - pi(.|s))
+    // 每个状态的梯度只依赖本状态的概率，所以逐状态原地更新即可，只触及出现过的状态
+    void update_theta(const BatchStats& stats, double learning_rate) {
+        for (int s : stats.states()) {
+            const ActionProbs& probs = theta.probs(s);
+            alignas(TABLE_ALIGNMENT) double grad[ACTION_STRIDE] = {};
+            for (int a = 0; a < ACTIONS; ++a) {
+                const PairStats& e = stats.at(s, a);
+                if (e.count > 0.0) {
+                    accumulate_log_softmax_grad(grad, probs.data(), a, e.sum_weight);
                 }
             }
+            double* row = theta.mutable_row(s);
+            for (int a = 0; a < ACTION_STRIDE; ++a) {
+                row[a] += learning_rate * grad[a];
+            }
         }
     }
     
@@ -105,49 +115,41 @@ public:
         std::vector<std::vector<int>> policy(ROWS, std::vector<int>(COLS));
         for (int r = 0; r < ROWS; ++r) {
             for (int c = 0; c < COLS; ++c) {
-                std::vector<double> probs = get_action_probs(r, c);
-                policy[r][c] = std::max_element(probs.begin(), probs.end()) - probs.begin();
+                policy[r][c] = theta.argmax(r, c);
             }
         }
         return policy;
     }
 };
 
-// 运行一个episode并返回轨迹
-Trajectory run_episode(const Grid& grid, PolicyNetwork& policy_net, int max_steps = 1000) {
-    Trajectory traj;
-    traj.total_return = 0.0;
+// 运行一个episode，轨迹直接追加到buffer中（RolloutBuffer逐步存储，RunLengthBuffer合并重复步），返回该episode的折扣回报
+template <typename Buffer>
+double run_episode(const Grid& grid, PolicyNetwork& policy_net, Buffer& buffer,
+                   Rng& rng, int max_steps = 1000) {
+    double total_return = 0.0;
     
     // 随机选择起始状态（避开禁止区域）
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<int> dist_r(0, ROWS - 1);
-    std::uniform_int_distribution<int> dist_c(0, COLS - 1);
-    
     int r, c;
     do {
-        r = dist_r(rng);
-        c = dist_c(rng);
+        r = rng.uniform_int(ROWS);
+        c = rng.uniform_int(COLS);
     } while (grid[r][c].type == StateType::Forbidden);
     
     double gamma_power = 1.0;  // gamma^t
     
     for (int step = 0; step < max_steps; ++step) {
-        // 记录当前状态
-        traj.states.emplace_back(r, c);
-        
         // 选择动作
-        int action = policy_net.sample_action(r, c);
-        traj.actions.push_back(action);
+        int action = policy_net.sample_action(r, c, rng);
         
         // 执行动作
         auto [next_r, next_c] = next_state(r, c, static_cast<Action>(action), grid);
         
-        // 获取奖励
+        // 获取奖励，记录(状态, 动作, 奖励)
         double reward = grid[next_r][next_c].reward;
-        traj.rewards.push_back(reward);
+        buffer.push(state_index(r, c), action, reward);
         
         // 累积折扣回报
-        traj.total_return += gamma_power * reward;
+        total_return += gamma_power * reward;
         gamma_power *= GAMMA;
         
         // 检查是否到达终止状态
@@ -164,6 +166,20 @@ Trajectory run_episode(const Grid& grid, PolicyNetwork& policy_net, int max_step
         c = next_c;
     }
     
+    buffer.end_episode(total_return);
+    return total_return;
+}
+
+// 运行一个episode并返回轨迹
+Trajectory run_episode(const Grid& grid, PolicyNetwork& policy_net, int max_steps = 1000) {
+    RolloutBuffer buffer;
+    Trajectory traj;
+    traj.total_return = run_episode(grid, policy_net, buffer, policy_net.generator(), max_steps);
+    for (size_t t = 0; t < buffer.num_steps(); ++t) {
+        traj.states.emplace_back(state_row(buffer.states[t]), state_col(buffer.states[t]));
+        traj.actions.push_back(buffer.actions[t]);
+        traj.rewards.push_back(buffer.rewards[t]);
+    }
     return traj;
 }
 
@@ -173,21 +189,24 @@ void reinforce(const Grid& grid,
                std::vector<std::vector<int>>& policy,
                int num_episodes = 1000,
                int episodes_per_update = 10,
-               double learning_rate = 0.01) {
+               double learning_rate = 0.01,
+               uint64_t seed = DEFAULT_SEED) {
     
-    PolicyNetwork policy_net;
-    std::vector<Trajectory> trajectories;
+    PolicyNetwork policy_net(seed);
+    RngStreams streams(seed);  // 每个episode一条独立的随机数流，结果可复现
+    RunLengthBuffer buffer;  // 跨更新复用，稳态下不再分配内存；原地不动的重复步只存一次
+    RolloutEngine<RunLengthBuffer> engine;  // 多线程并行采样，batch内容与线程数无关
     
-    for (int episode = 0; episode < num_episodes; ++episode) {
-        // 运行一个episode
-        Trajectory traj = run_episode(grid, policy_net);
-        trajectories.push_back(traj);
+    // 每收集episodes_per_update个episode更新一次策略（不足一批的尾部episode不参与更新，故不采样）
+    int num_updates = num_episodes / episodes_per_update;
+    for (int update = 0; update < num_updates; ++update) {
+        // 并行运行一批episode，采样期间策略只读
+        policy_net.prepare_rollouts();
+        engine.collect(buffer, streams, static_cast<uint64_t>(update) * episodes_per_update, episodes_per_update,
+                       [&](RunLengthBuffer& out, Rng& rng) { run_episode(grid, policy_net, out, rng); });
         
-        // 每收集一定数量的episode就更新一次策略
-        if ((episode + 1) % episodes_per_update == 0) {
-            policy_net.update_theta(trajectories, learning_rate);
-            trajectories.clear();  // 清空轨迹缓冲区
-        }
+        policy_net.update_theta(buffer, learning_rate);
+        buffer.clear();  // 清空轨迹缓冲区（保留容量）
     }
     
     // 获取最终的最优策略
@@ -203,7 +222,7 @@ void reinforce(const Grid& grid,
                 V[r][c] = grid[r][c].reward;
             } else {
                 // 对于普通状态，计算期望值
-                std::vector<double> probs = policy_net.get_action_probs(r, c);
+                ActionProbs probs = policy_net.get_action_probs(r, c);
                 for (int a = 0; a < ACTIONS; ++a) {
                     auto [next_r, next_c] = next_state(r, c, static_cast<Action>(a), grid);
                     V[r][c] += probs[a] * (grid[next_r][next_c].reward + GAMMA * V[next_r][next_c]);
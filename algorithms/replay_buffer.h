@@ -0,0 +1,116 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef REPLAY_BUFFER_H
+#define REPLAY_BUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "../utils/rng.h"
+
+// One stored transition, decoded from the ring's columns
+struct Transition {
+    uint32_t state;       // state id (state_index(r, c))
+    uint32_t next_state;
+    uint8_t action;
+    float reward;
+    bool done;
+};
+
+// Fixed-capacity experience replay ring with structure-of-arrays storage.
+// Columns hold 4-byte state ids, 1-byte actions, float rewards and one done bit per slot;
+// with the 4-byte sequence counter below, a slot costs 17 bytes plus its done bit
+// (13 of them transition data) instead of a heap node of pairs and ints.
+//
+// One producer (push) and any number of consumers (size, sample, load) may run
+// concurrently without locks. Each slot carries a sequence counter that is odd while
+// the producer rewrites it; load() retries until it reads a slot between two equal
+// even counters, so a consumer never sees a half-overwritten transition. Column
+// accesses go through relaxed std::atomic_ref, ordered by the counter's fences.
+class ReplayBuffer {
+private:
+    size_t capacity_;
+    std::vector<uint32_t> states;
+    std::vector<uint32_t> next_states;
+    std::vector<uint8_t> actions;
+    std::vector<float> rewards;
+    std::vector<std::atomic<uint64_t>> done_bits;  // 64 slots per word
+    std::vector<std::atomic<uint32_t>> seq;        // per-slot seqlock
+    std::atomic<uint64_t> pushed{0};               // total transitions ever pushed
+
+    template <typename T>
+    static void store(T& field, T value) { std::atomic_ref<T>(field).store(value, std::memory_order_relaxed); }
+    template <typename T>
+    static T read(const T& field) { return std::atomic_ref<T>(const_cast<T&>(field)).load(std::memory_order_relaxed); }
+
+public:
+    explicit ReplayBuffer(size_t capacity = 10000)
+        : capacity_(std::max<size_t>(capacity, 1)),
+          states(capacity_), next_states(capacity_), actions(capacity_), rewards(capacity_),
+          done_bits((capacity_ + 63) / 64), seq(capacity_) {}
+
+    ReplayBuffer(const ReplayBuffer&) = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    // Producer only: overwrite the oldest slot once the ring is full; returns the slot written
+    uint32_t push(int state, int action, double reward, int next_state, bool done) {
+        uint64_t n = pushed.load(std::memory_order_relaxed);
+        size_t slot = static_cast<size_t>(n % capacity_);
+        uint32_t s = seq[slot].load(std::memory_order_relaxed);
+        seq[slot].store(s + 1, std::memory_order_relaxed);  // odd: slot is being written
+        std::atomic_thread_fence(std::memory_order_release);
+
+        store(states[slot], static_cast<uint32_t>(state));
+        store(next_states[slot], static_cast<uint32_t>(next_state));
+        store(actions[slot], static_cast<uint8_t>(action));
+        store(rewards[slot], static_cast<float>(reward));
+        uint64_t bit = uint64_t{1} << (slot % 64);
+        if (done) {
+            done_bits[slot / 64].fetch_or(bit, std::memory_order_relaxed);
+        } else {
+            done_bits[slot / 64].fetch_and(~bit, std::memory_order_relaxed);
+        }
+
+        seq[slot].store(s + 2, std::memory_order_release);
+        pushed.store(n + 1, std::memory_order_release);
+        return static_cast<uint32_t>(slot);
+    }
+
+    // Number of filled slots; sampled indices are always below it
+    size_t size() const {
+        return static_cast<size_t>(std::min<uint64_t>(pushed.load(std::memory_order_acquire), capacity_));
+    }
+    size_t capacity() const { return capacity_; }
+
+    // Uniform slot indices with replacement into out (resized to batch_size, or to size() if smaller).
+    // Every consumer passes its own Rng.
+    void sample(size_t batch_size, Rng& rng, std::vector<uint32_t>& out) const {
+        size_t n = size();
+        out.resize(std::min(batch_size, n));
+        for (uint32_t& idx : out) {
+            idx = static_cast<uint32_t>(rng.uniform_index(n));
+        }
+    }
+
+    // Consistent snapshot of one slot
+    Transition load(uint32_t slot) const {
+        Transition t;
+        while (true) {
+            uint32_t before = seq[slot].load(std::memory_order_acquire);
+            if (before & 1u) continue;  // producer is mid-write
+            t.state = read(states[slot]);
+            t.next_state = read(next_states[slot]);
+            t.action = read(actions[slot]);
+            t.reward = read(rewards[slot]);
+            t.done = (done_bits[slot / 64].load(std::memory_order_relaxed) >> (slot % 64)) & 1u;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq[slot].load(std::memory_order_relaxed) == before) return t;
+        }
+    }
+};
+
+#endif //REPLAY_BUFFER_H
@@ -0,0 +1,89 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef ROLLOUT_BUFFER_H
+#define ROLLOUT_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Structure-of-arrays rollout storage shared by the policy-gradient trainers.
+// Episodes are stored back to back; episode e covers [offsets[e], offsets[e + 1]).
+// clear() keeps every column's capacity, so a buffer reused across updates stops
+// allocating once it has seen its largest batch.
+class RolloutBuffer {
+public:
+    std::vector<int32_t> states;       // state ids (state_index(r, c))
+    std::vector<uint8_t> actions;
+    std::vector<double> rewards;
+    std::vector<double> log_probs;     // behaviour log-probability of the taken action
+    std::vector<double> advantages;    // filled by trainers that estimate advantages
+    std::vector<double> value_targets; // per-step value regression targets, filled with advantages
+    std::vector<size_t> offsets{0};    // episode start indices, plus one end marker
+    std::vector<double> returns;       // discounted return of each episode
+
+    void reserve(size_t steps, size_t episodes) {
+        states.reserve(steps);
+        actions.reserve(steps);
+        rewards.reserve(steps);
+        log_probs.reserve(steps);
+        advantages.reserve(steps);
+        value_targets.reserve(steps);
+        offsets.reserve(episodes + 1);
+        returns.reserve(episodes);
+    }
+
+    void clear() {
+        states.clear();
+        actions.clear();
+        rewards.clear();
+        log_probs.clear();
+        advantages.clear();
+        value_targets.clear();
+        offsets.assign(1, 0);
+        returns.clear();
+    }
+
+    void push(int state, int action, double reward, double log_prob = 0.0) {
+        states.push_back(state);
+        actions.push_back(static_cast<uint8_t>(action));
+        rewards.push_back(reward);
+        log_probs.push_back(log_prob);
+    }
+
+    // Close the episode started after the previous end_episode() call
+    void end_episode(double total_return) {
+        offsets.push_back(states.size());
+        returns.push_back(total_return);
+    }
+
+    // Append another buffer's complete episodes, preserving their order
+    void append(const RolloutBuffer& other) {
+        size_t base = states.size();
+        states.insert(states.end(), other.states.begin(), other.states.end());
+        actions.insert(actions.end(), other.actions.begin(), other.actions.end());
+        rewards.insert(rewards.end(), other.rewards.begin(), other.rewards.end());
+        log_probs.insert(log_probs.end(), other.log_probs.begin(), other.log_probs.end());
+        advantages.insert(advantages.end(), other.advantages.begin(), other.advantages.end());
+        value_targets.insert(value_targets.end(), other.value_targets.begin(), other.value_targets.end());
+        for (size_t e = 1; e < other.offsets.size(); ++e) {
+            offsets.push_back(base + other.offsets[e]);
+        }
+        returns.insert(returns.end(), other.returns.begin(), other.returns.end());
+    }
+
+    size_t num_steps() const { return states.size(); }
+    size_t num_episodes() const { return returns.size(); }
+    size_t episode_begin(size_t e) const { return offsets[e]; }
+    size_t episode_end(size_t e) const { return offsets[e + 1]; }
+
+    // Episode containing step t
+    size_t episode_of(size_t t) const {
+        return static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), t) - offsets.begin()) - 1;
+    }
+};
+
+#endif //ROLLOUT_BUFFER_H
@@ -0,0 +1,51 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef ROLLOUT_ENGINE_H
+#define ROLLOUT_ENGINE_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "rollout_buffer.h"
+#include "run_length_buffer.h"
+#include "../utils/rng.h"
+#include "../utils/thread_pool.h"
+
+// Parallel episode collection for the on-policy trainers.
+// Episodes are split into one contiguous range per thread; each thread writes into its
+// own buffer and the buffers are appended in range order. Episode k always draws from
+// streams.stream(k), so the resulting batch is identical for any thread count.
+// Episode functions only read the policy, which must not be written during collect().
+// Buffer is RolloutBuffer or RunLengthBuffer.
+template <typename Buffer = RolloutBuffer>
+class RolloutEngine {
+private:
+    ThreadPool& pool;
+    std::vector<Buffer> local;  // per-thread buffers, reused across calls
+
+public:
+    explicit RolloutEngine(ThreadPool& pool = default_thread_pool()) : pool(pool), local(pool.size()) {}
+
+    // run(Buffer&, Rng&) collects one episode into the given buffer
+    template <typename EpisodeFn>
+    void collect(Buffer& out, const RngStreams& streams, uint64_t first_episode,
+                 size_t num_episodes, EpisodeFn&& run) {
+        pool.parallel_for(num_episodes, [&](size_t chunk, size_t begin, size_t end) {
+            // the first range goes straight into the output buffer
+            Buffer& buf = chunk == 0 ? out : local[chunk];
+            if (chunk != 0) buf.clear();
+            for (size_t e = begin; e < end; ++e) {
+                Rng rng = streams.stream(first_episode + e);
+                run(buf, rng);
+            }
+        });
+        size_t chunks = std::min(num_episodes, pool.size());
+        for (size_t k = 1; k < chunks; ++k) {
+            out.append(local[k]);
+        }
+    }
+};
+
+#endif //ROLLOUT_ENGINE_H
@@ -0,0 +1,112 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef RUN_LENGTH_BUFFER_H
+#define RUN_LENGTH_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Rollout storage that keeps consecutive identical steps as one run.
+// In a deterministic grid a STAY action or a wall bump leaves the agent where it was, so
+// an episode often repeats the same (state, action, reward, behaviour probability) step
+// many times. Such steps are stored once with a length, and consumers work per run:
+// batch statistics add a run as n = length identical timesteps (REINFORCE and TRPO weight
+// every step by its episode's return). Memory and update cost scale with the number of
+// runs instead of the number of steps.
+//
+// Interface mirrors RolloutBuffer (push, end_episode, clear, append), so the same episode
+// functions and RolloutEngine can fill either. Run i of an episode covers its steps
+// [starts[i], starts[i] + lengths[i]).
+class RunLengthBuffer {
+public:
+    std::vector<int32_t> states;     // state id of each run
+    std::vector<uint8_t> actions;
+    std::vector<double> rewards;     // per-step reward
+    std::vector<double> log_probs;   // per-step behaviour log-probability
+    std::vector<uint32_t> lengths;   // steps in the run
+    std::vector<uint32_t> starts;    // index of the run's first step within its episode
+    std::vector<size_t> offsets{0};  // first run of each episode, plus one end marker
+    std::vector<double> returns;     // discounted return of each episode
+    size_t steps = 0;
+
+    void reserve(size_t runs, size_t episodes) {
+        states.reserve(runs);
+        actions.reserve(runs);
+        rewards.reserve(runs);
+        log_probs.reserve(runs);
+        lengths.reserve(runs);
+        starts.reserve(runs);
+        offsets.reserve(episodes + 1);
+        returns.reserve(episodes);
+    }
+
+    void clear() {
+        states.clear();
+        actions.clear();
+        rewards.clear();
+        log_probs.clear();
+        lengths.clear();
+        starts.clear();
+        offsets.assign(1, 0);
+        returns.clear();
+        steps = 0;
+    }
+
+    // Append one step; it extends the open episode's last run when it repeats it exactly.
+    // Equal consecutive states mean the previous step looped back to its own state.
+    void push(int state, int action, double reward, double log_prob = 0.0) {
+        size_t n = states.size();
+        if (n > offsets.back() && states[n - 1] == state && actions[n - 1] == action &&
+            rewards[n - 1] == reward && log_probs[n - 1] == log_prob) {
+            ++lengths[n - 1];
+        } else {
+            uint32_t start = n > offsets.back() ? starts[n - 1] + lengths[n - 1] : 0;
+            states.push_back(state);
+            actions.push_back(static_cast<uint8_t>(action));
+            rewards.push_back(reward);
+            log_probs.push_back(log_prob);
+            lengths.push_back(1);
+            starts.push_back(start);
+        }
+        ++steps;
+    }
+
+    // Close the episode started after the previous end_episode() call
+    void end_episode(double total_return) {
+        offsets.push_back(states.size());
+        returns.push_back(total_return);
+    }
+
+    // Append another buffer's complete episodes, preserving their order
+    void append(const RunLengthBuffer& other) {
+        size_t base = states.size();
+        states.insert(states.end(), other.states.begin(), other.states.end());
+        actions.insert(actions.end(), other.actions.begin(), other.actions.end());
+        rewards.insert(rewards.end(), other.rewards.begin(), other.rewards.end());
+        log_probs.insert(log_probs.end(), other.log_probs.begin(), other.log_probs.end());
+        lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+        starts.insert(starts.end(), other.starts.begin(), other.starts.end());
+        for (size_t e = 1; e < other.offsets.size(); ++e) {
+            offsets.push_back(base + other.offsets[e]);
+        }
+        returns.insert(returns.end(), other.returns.begin(), other.returns.end());
+        steps += other.steps;
+    }
+
+    size_t num_runs() const { return states.size(); }
+    size_t num_steps() const { return steps; }
+    size_t num_episodes() const { return returns.size(); }
+    size_t episode_begin(size_t e) const { return offsets[e]; }
+    size_t episode_end(size_t e) const { return offsets[e + 1]; }
+
+    // Episode containing run i
+    size_t episode_of(size_t i) const {
+        return static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin()) - 1;
+    }
+};
+
+#endif //RUN_LENGTH_BUFFER_H
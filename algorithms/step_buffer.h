@@ -0,0 +1,140 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef STEP_BUFFER_H
+#define STEP_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "../env/gridworld.h"
+#include "../utils/rng.h"
+
+// Fixed-size rollout storage for N environments stepped in lockstep for T steps.
+// Every column is a flat [t][env] array (index t * num_envs + env): one time step of all
+// environments is contiguous, so backward scans over t run across environments.
+// The buffer is sized once and overwritten in place by every rollout.
+class StepBuffer {
+private:
+    size_t T, N;
+
+public:
+    std::vector<int32_t> states;           // state ids (state_index(r, c))
+    std::vector<uint8_t> actions;
+    std::vector<double> rewards;
+    std::vector<double> log_probs;         // behaviour log-probability of the taken action
+    std::vector<uint8_t> dones;            // 1 if the episode ended with this step
+    std::vector<double> values;            // V(s_t) when the step was collected
+    std::vector<double> advantages;
+    std::vector<double> returns;           // regression targets for the value update
+    std::vector<double> bootstrap_values;  // V(s_T) of each environment's unfinished episode
+    // A step cut off by a time limit is stored with done = 1 and reward r + gamma * V(s'),
+    // so the GAE scan bootstraps it instead of treating the time limit as terminal.
+
+    StepBuffer(size_t horizon, size_t num_envs)
+        : T(horizon), N(num_envs),
+          states(horizon * num_envs), actions(horizon * num_envs), rewards(horizon * num_envs),
+          log_probs(horizon * num_envs), dones(horizon * num_envs), values(horizon * num_envs),
+          advantages(horizon * num_envs), returns(horizon * num_envs), bootstrap_values(num_envs) {}
+
+    size_t horizon() const { return T; }
+    size_t num_envs() const { return N; }
+    size_t size() const { return T * N; }
+    size_t index(size_t t, size_t env) const { return t * N + env; }
+
+    // GAE(lambda) in one fused backward pass over t, vectorised across environments:
+    //   delta_t = r_t + gamma * (1 - done_t) * V(s_{t+1}) - V(s_t)
+    //   A_t     = delta_t + gamma * lambda * (1 - done_t) * A_{t+1}
+    // with V(s_T) taken from bootstrap_values. returns = A + V are the value targets;
+    // lambda = 1 gives the bootstrapped discounted return-to-go.
+    void compute_gae(double gamma, double lambda) {
+        for (size_t t = T; t-- > 0;) {
+            const size_t base = t * N;
+            const bool last = t + 1 == T;
+            const double* __restrict next_value = last ? bootstrap_values.data() : &values[base + N];
+            // no A_T: the last row reads any finite column and scales it by zero
+            const double* __restrict next_adv = last ? bootstrap_values.data() : &advantages[base + N];
+            const double trace = last ? 0.0 : gamma * lambda;
+            const double* __restrict r = &rewards[base];
+            const double* __restrict v = &values[base];
+            const uint8_t* __restrict d = &dones[base];
+            double* __restrict adv = &advantages[base];
+            double* __restrict ret = &returns[base];
+            for (size_t env = 0; env < N; ++env) {
+                double live = 1.0 - d[env];
+                double delta = r[env] + gamma * live * next_value[env] - v[env];
+                adv[env] = delta + trace * live * next_adv[env];
+                ret[env] = adv[env] + v[env];
+            }
+        }
+    }
+};
+
+// N grid environments that persist across rollouts: an episode still running at the
+// end of one rollout continues in the next, up to time_limit steps (0 = no limit).
+// Environment e only draws from its own stream, so rollouts do not depend on how
+// environments are spread over threads.
+class VecGridEnv {
+private:
+    const Grid& grid;
+    std::vector<int32_t> current;  // state id of each environment
+    std::vector<int32_t> elapsed;  // steps taken in each environment's current episode
+    std::vector<Rng> rngs;
+    int time_limit;
+
+public:
+    VecGridEnv(const Grid& grid, size_t num_envs, const RngStreams& streams, int time_limit = 0)
+        : grid(grid), current(num_envs), elapsed(num_envs, 0), time_limit(time_limit) {
+        rngs.reserve(num_envs);
+        for (size_t env = 0; env < num_envs; ++env) {
+            rngs.push_back(streams.stream(env));
+            reset(env);
+        }
+    }
+
+    size_t num_envs() const { return current.size(); }
+    int state(size_t env) const { return current[env]; }
+    Rng& rng(size_t env) { return rngs[env]; }
+
+    // Random starting state (avoid forbidden areas)
+    void reset(size_t env) {
+        int r, c;
+        do {
+            r = rngs[env].uniform_int(ROWS);
+            c = rngs[env].uniform_int(COLS);
+        } while (grid[r][c].type == StateType::Forbidden);
+        current[env] = state_index(r, c);
+        elapsed[env] = 0;
+    }
+
+    // Apply an action and return its reward. Entering a terminal or forbidden
+    // state ends the episode: done is set and the environment restarts.
+    // Reaching the time limit in a normal state also restarts it, but sets truncated
+    // instead and leaves that state in cut_state for the caller to bootstrap from.
+    double step(size_t env, int action, bool& done, bool& truncated, int& cut_state) {
+        int s = current[env];
+        auto [next_r, next_c] = next_state(state_row(s), state_col(s), static_cast<Action>(action), grid);
+        double reward = grid[next_r][next_c].reward;
+        done = grid[next_r][next_c].type != StateType::Normal;
+        truncated = !done && time_limit > 0 && ++elapsed[env] >= time_limit;
+        if (done || truncated) {
+            cut_state = state_index(next_r, next_c);
+            reset(env);
+        } else {
+            current[env] = state_index(next_r, next_c);
+        }
+        return reward;
+    }
+
+    // Same, treating a time limit like the end of the episode
+    double step(size_t env, int action, bool& done) {
+        bool truncated;
+        int cut_state;
+        double reward = step(env, action, done, truncated, cut_state);
+        done = done || truncated;
+        return reward;
+    }
+};
+
+#endif //STEP_BUFFER_H
@@ -0,0 +1,107 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef TARGET_NETWORK_H
+#define TARGET_NETWORK_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include "policy_table.h"
+
+// How a target table follows its online table
+enum class TargetUpdate {
+    Lazy,     // Polyak averaging applied per row on demand, in closed form
+    Fused,    // Polyak averaging as one dense pass over the flat store every step
+    HardCopy  // copy the whole online table every copy_period steps
+};
+
+// Slowly tracking copy of an online TabularParams, shared by the DDPG actor and critic.
+//
+// Polyak averaging t <- tau * o + (1 - tau) * t applied m times to a row whose online
+// values o did not change in between is t <- o + (1 - tau)^m * (t - o). Lazy mode
+// therefore makes step() O(1) and only records, per row, the step it is current to;
+// a row is brought up to date when it is read and, crucially, before its online row is
+// written (the owner calls before_write), so the online row is constant over every
+// gap that is caught up. Rows that are never touched cost nothing.
+class TargetNetwork {
+private:
+    const TabularParams& online;
+    TabularParams target;
+    TargetUpdate mode;
+    double tau;
+    uint64_t copy_period;
+    uint64_t steps = 0;
+    std::vector<uint64_t> synced;  // Lazy: step count each row is current to
+
+    void catch_up(int s) {
+        uint64_t gap = steps - synced[s];
+        if (gap == 0) return;
+        double keep = std::pow(1.0 - tau, static_cast<double>(gap));
+        double* t = target.row(s);
+        const double* o = online.row(s);
+        for (int a = 0; a < ACTIONS; ++a) {
+            t[a] = o[a] + keep * (t[a] - o[a]);
+        }
+        synced[s] = steps;
+    }
+
+public:
+    // copy_period = 0 picks round(1 / tau), the time constant of the equivalent Polyak average
+    TargetNetwork(const TabularParams& online, TargetUpdate mode = TargetUpdate::Lazy,
+                  double tau = 0.001, uint64_t copy_period = 0)
+        : online(online), target(online), mode(mode), tau(tau),
+          copy_period(copy_period ? copy_period : static_cast<uint64_t>(std::max(1.0, std::round(1.0 / tau)))),
+          synced(NUM_STATES, 0) {}
+
+    TargetNetwork(const TargetNetwork&) = delete;
+    TargetNetwork& operator=(const TargetNetwork&) = delete;
+
+    // One target update. A changed tau first settles every row at the old rate.
+    void step(double new_tau) {
+        if (new_tau != tau) {
+            sync_all();
+            tau = new_tau;
+        }
+        ++steps;
+        switch (mode) {
+            case TargetUpdate::Lazy:
+                break;
+            case TargetUpdate::Fused:
+                target.lerp_towards(online, tau);
+                break;
+            case TargetUpdate::HardCopy:
+                if (steps % copy_period == 0) target = online;
+                break;
+        }
+    }
+    void step() { step(tau); }
+
+    // Must be called before the online row s is modified
+    void before_write(int s) {
+        if (mode == TargetUpdate::Lazy) catch_up(s);
+    }
+
+    // Current target row of state s
+    const double* row(int s) {
+        if (mode == TargetUpdate::Lazy) catch_up(s);
+        return target.row(s);
+    }
+
+    // Bring every row up to date
+    void sync_all() {
+        if (mode != TargetUpdate::Lazy) return;
+        for (int s = 0; s < NUM_STATES; ++s) catch_up(s);
+    }
+
+    // Whole target table, fully synchronised
+    const TabularParams& params() {
+        sync_all();
+        return target;
+    }
+
+    TargetUpdate update_mode() const { return mode; }
+};
+
+#endif //TARGET_NETWORK_H
@@ -6,12 +6,18 @@
 #define TRPO_H
 
 #include <vector>
-#include <random>
+#include <array>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
 #include "../env/gridworld.h"
 #include "../env/mdp_config.h"
+#include "policy_table.h"
+#include "batch_stats.h"
+#include "rollout_buffer.h"
+#include "run_length_buffer.h"
+#include "rollout_engine.h"
+#include "../utils/rng.h"
 
 // Trajectory structure for TRPO
 struct TRPOTrajectory {
@@ -22,73 +28,114 @@ struct TRPOTrajectory {
     double total_return;                      // Total discounted return
 };
 
+// How the natural-gradient direction F^{-1} g is obtained
+enum class NaturalGradientSolver {
+    Diagonal,           // taken-action diagonal approximation (original behaviour)
+    ConjugateGradient,  // fixed-iteration CG on Fisher-vector products, F is never formed
+    BlockExact          // exact per-state solve of the ACTIONS x ACTIONS softmax Fisher block
+};
+
 // Policy network for TRPO
 class TRPOPolicyNetwork {
 private:
-    std::vector<std::vector<std::vector<double>>> theta;  // Policy parameters [state_r][state_c][action]
-    std::mt19937 rng;  // Random number generator
+    SoftmaxPolicy theta;  // Policy parameters [state][action] with cached probabilities
+    BatchStats batch;  // Per-(state, action) sums of the current batch, reused across updates
+    ParallelBatchCompressor compressor;  // Blocked parallel compression with a deterministic reduction
+    Rng rng;  // Random number generator for the convenience overloads
+    NaturalGradientSolver solver = NaturalGradientSolver::BlockExact;
+    int cg_iters = 10;
+    
+    static constexpr int LINE_SEARCH_STEPS = 10;      // candidate step sizes 1, 1/2, ..., 1/2^9
+    static constexpr size_t LINE_SEARCH_BLOCK = 256;  // states per line-search work block
+    static constexpr int LINE_SEARCH_GROUP = 2;       // candidates per line-search work item
+    static_assert(LINE_SEARCH_STEPS % LINE_SEARCH_GROUP == 0, "candidate groups must tile the step sizes");
     
 public:
-    TRPOPolicyNetwork() : rng(std::random_device{}()) {
-        // Initialize policy parameters
-        theta.assign(ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
+    explicit TRPOPolicyNetwork(uint64_t seed = DEFAULT_SEED) : theta(0.0), rng(seed) {}
+    
+    void set_natural_gradient_solver(NaturalGradientSolver s, int iters = 10) {
+        solver = s;
+        cg_iters = iters;
     }
     
     // Get action probability distribution
-    std::vector<double> get_action_probs(int r, int c) {
-        std::vector<double> logits = theta[r][c];
-        std::vector<double> probs(ACTIONS);
-        
-        // Compute softmax with numerical stability
-        double max_logit = *std::max_element(logits.begin(), logits.end());
-        double sum_exp = 0.0;
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] = std::exp(logits[a] - max_logit);
-            sum_exp += probs[a];
-        }
-        
-        // Normalize
-        for (int a = 0; a < ACTIONS; ++a) {
-            probs[a] /= sum_exp;
-        }
-        
-        return probs;
+    ActionProbs get_action_probs(int r, int c) {
+        return theta.probs(r, c);
+    }
+    
+    // Sample action according to policy; optionally report its probability from the same softmax
+    int sample_action(int r, int c, Rng& gen, double* action_prob = nullptr) {
+        const ActionProbs& probs = theta.probs(r, c);
+        int action = sample_from_probs(probs.data(), gen);
+        if (action_prob) *action_prob = probs[action];
+        return action;
     }
     
-    // Sample action according to policy
-    int sample_action(int r, int c) {
-        std::vector<double> probs = get_action_probs(r, c);
-        std::discrete_distribution<int> dist(probs.begin(), probs.end());
-        return dist(rng);
+    int sample_action(int r, int c, double* action_prob = nullptr) {
+        return sample_action(r, c, rng, action_prob);
     }
     
+    // Network-owned random stream
+    Rng& generator() { return rng; }
+    
+    // Call before parallel rollouts: refreshes the probability cache so threads only read the policy
+    void prepare_rollouts() const { theta.refresh(); }
+    
+    // Raw logit table (for published snapshots)
+    const TabularParams& params() const { return theta.params(); }
+    
     // Get action probability
     double get_action_prob(int r, int c, int action) {
-        std::vector<double> probs = get_action_probs(r, c);
-        return probs[action];
+        return theta.probs(r, c)[action];
     }
     
-    // Compute policy gradient
-    std::vector<std::vector<std::vector<double>>> compute_policy_gradient(
-        const std::vector<TRPOTrajectory>& trajectories) {
-        
-        std::vector<std::vector<std::vector<double>>> gradients(
-            ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-        
+    // Compress a batch into per-(state, action) return sums and behaviour probabilities
+    const BatchStats& compress(const std::vector<TRPOTrajectory>& trajectories) {
+        batch.clear();
         for (const auto& traj : trajectories) {
             for (size_t t = 0; t < traj.states.size(); ++t) {
-                int r = traj.states[t].first;
-                int c = traj.states[t].second;
-                int action = traj.actions[t];
-                
-                // Compute policy gradient
-                std::vector<double> probs = get_action_probs(r, c);
-                for (int a = 0; a < ACTIONS; ++a) {
-                    if (a == action) {
-                        gradients[r][c][a] += (1.0 - probs[a]) * traj.total_return;
-                    } else {
-                        gradients[r][c][a] += (-probs[a]) * traj.total_return;
-                    }
+                int s = state_index(traj.states[t].first, traj.states[t].second);
+                batch.add(s, traj.actions[t], traj.total_return, traj.action_probs[t]);
+            }
+        }
+        return batch;
+    }
+    
+    // Same compression read straight from the SoA rollout buffer
+    // (blocks are compressed on the worker pool and reduced in a fixed tree, see ParallelBatchCompressor)
+    const BatchStats& compress(const RolloutBuffer& buffer) {
+        compressor.compress(batch, buffer.num_steps(), [&](BatchStats& out, size_t begin, size_t end) {
+            for (size_t t = begin, e = buffer.episode_of(begin); t < end; ++t) {
+                while (t >= buffer.episode_end(e)) ++e;
+                out.add(buffer.states[t], buffer.actions[t], buffer.returns[e], std::exp(buffer.log_probs[t]));
+            }
+        });
+        return batch;
+    }
+    
+    // Run-length compression: each run adds its length as n identical timesteps, so the
+    // gradient, Fisher and KL sums cost O(runs)
+    const BatchStats& compress(const RunLengthBuffer& buffer) {
+        compressor.compress(batch, buffer.num_runs(), [&](BatchStats& out, size_t begin, size_t end) {
+            for (size_t i = begin, e = buffer.episode_of(begin); i < end; ++i) {
+                while (i >= buffer.episode_end(e)) ++e;
+                out.add(buffer.states[i], buffer.actions[i], buffer.returns[e], std::exp(buffer.log_probs[i]),
+                        buffer.lengths[i]);
+            }
+        });
+        return batch;
+    }
+    
+    // Compute policy gradient
+    TabularParams compute_policy_gradient(const BatchStats& stats) {
+        TabularParams gradients(0.0);
+        
+        for (int s : stats.states()) {
+            const ActionProbs& probs = theta.probs(s);
+            for (int a = 0; a < ACTIONS; ++a) {
+                const PairStats& e = stats.at(s, a);
+                if (e.count > 0.0) {
+                    accumulate_log_softmax_grad(gradients.row(s), probs.data(), a, e.sum_weight);
                 }
             }
         }
@@ -97,21 +144,14 @@ public:
     }
     
     // Compute Fisher Information Matrix (simplified diagonal approximation)
-    std::vector<std::vector<std::vector<double>>> compute_fisher_info(
-        const std::vector<TRPOTrajectory>& trajectories) {
-        
-        std::vector<std::vector<std::vector<double>>> fisher_info(
-            ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
+    TabularParams compute_fisher_info(const BatchStats& stats) {
+        TabularParams fisher_info(0.0);
         
-        for (const auto& traj : trajectories) {
-            for (size_t t = 0; t < traj.states.size(); ++t) {
-                int r = traj.states[t].first;
-                int c = traj.states[t].second;
-                int action = traj.actions[t];
-                
-                std::vector<double> probs = get_action_probs(r, c);
+        for (int s : stats.states()) {
+            const ActionProbs& probs = theta.probs(s);
+            for (int a = 0; a < ACTIONS; ++a) {
                 // Diagonal Fisher information matrix
-                fisher_info[r][c][action] += 1.0 / (probs[action] + 1e-8);
+                fisher_info.row(s)[a] += stats.at(s, a).count / (probs[a] + 1e-8);
             }
         }
         
@@ -121,107 +161,232 @@ public:
     // Update policy using TRPO
     void update_policy_trpo(const std::vector<TRPOTrajectory>& trajectories, 
                            double max_kl = 0.01, double damping = 0.1) {
+        update_policy_trpo(compress(trajectories), max_kl, damping);
+    }
+    
+    void update_policy_trpo(const RolloutBuffer& buffer, double max_kl = 0.01, double damping = 0.1) {
+        update_policy_trpo(compress(buffer), max_kl, damping);
+    }
+    
+    void update_policy_trpo(const RunLengthBuffer& buffer, double max_kl = 0.01, double damping = 0.1) {
+        update_policy_trpo(compress(buffer), max_kl, damping);
+    }
+    
+    // The softmax Fisher of the batch is block-diagonal: state s contributes
+    // n_s * (diag(p_s) - p_s p_s^T), with n_s its visit count. Returns (F + damping I) v
+    // on the visited rows without ever forming F.
+    void fisher_vector_product(const BatchStats& stats, const TabularParams& v, TabularParams& out, double damping) {
+        for (int s : stats.states()) {
+            const ActionProbs& p = theta.probs(s);
+            const double* vs = v.row(s);
+            double* os = out.row(s);
+            double n = 0.0, pv = 0.0;
+            for (int a = 0; a < ACTIONS; ++a) {
+                n += stats.at(s, a).count;
+                pv += p[a] * vs[a];
+            }
+            for (int a = 0; a < ACTIONS; ++a) {
+                os[a] = n * p[a] * (vs[a] - pv) + damping * vs[a];
+            }
+        }
+    }
+    
+    // Conjugate gradient on (F + damping I) x = g with a fixed iteration count
+    TabularParams solve_conjugate_gradient(const BatchStats& stats, const TabularParams& g, double damping) {
+        auto dot = [&](const TabularParams& a, const TabularParams& b) {
+            double sum = 0.0;
+            for (int s : stats.states()) {
+                for (int k = 0; k < ACTIONS; ++k) sum += a.row(s)[k] * b.row(s)[k];
+            }
+            return sum;
+        };
         
-        auto gradients = compute_policy_gradient(trajectories);
-        auto fisher_info = compute_fisher_info(trajectories);
-        
-        // Compute natural gradient using Fisher information matrix
-        std::vector<std::vector<std::vector<double>>> natural_gradients(
-            ROWS, std::vector<std::vector<double>>(COLS, std::vector<double>(ACTIONS, 0.0)));
-        
-        for (int r = 0; r < ROWS; ++r) {
-            for (int c = 0; c < COLS; ++c) {
-                for (int a = 0; a < ACTIONS; ++a) {
-                    if (fisher_info[r][c][a] > 1e-8) {
-                        natural_gradients[r][c][a] = gradients[r][c][a] / (fisher_info[r][c][a] + damping);
-                    }
+        TabularParams x(0.0), r = g, d = g, Fd(0.0);
+        double rr = dot(r, r);
+        for (int it = 0; it < cg_iters && rr > 1e-20; ++it) {
+            fisher_vector_product(stats, d, Fd, damping);
+            double alpha = rr / dot(d, Fd);
+            for (int s : stats.states()) {
+                for (int k = 0; k < ACTIONS; ++k) {
+                    x.row(s)[k] += alpha * d.row(s)[k];
+                    r.row(s)[k] -= alpha * Fd.row(s)[k];
                 }
             }
+            double rr_new = dot(r, r);
+            double beta = rr_new / rr;
+            for (int s : stats.states()) {
+                for (int k = 0; k < ACTIONS; ++k) d.row(s)[k] = r.row(s)[k] + beta * d.row(s)[k];
+            }
+            rr = rr_new;
         }
-        
-        // Compute step size using line search
-        double step_size = compute_trpo_step_size(trajectories, natural_gradients, max_kl);
-        
-        // Update parameters
-        for (int r = 0; r < ROWS; ++r) {
-            for (int c = 0; c < COLS; ++c) {
-                for (int a = 0; a < ACTIONS; ++a) {
-                    theta[r][c][a] += step_size * natural_gradients[r][c][a];
+        return x;
+    }
+    
+    // Exact solve of each block: n (diag(p) - p p^T) + damping I = D - u u^T with
+    // D = diag(n p + damping) and u = sqrt(n) p, so Sherman-Morrison gives
+    // x = D^-1 g + D^-1 u (u^T D^-1 g) / (1 - u^T D^-1 u) in O(ACTIONS) per state
+    TabularParams solve_block_exact(const BatchStats& stats, const TabularParams& g, double damping) {
+        TabularParams x(0.0);
+        for (int s : stats.states()) {
+            const ActionProbs& p = theta.probs(s);
+            const double* gs = g.row(s);
+            double n = 0.0;
+            for (int a = 0; a < ACTIONS; ++a) n += stats.at(s, a).count;
+            
+            double ug = 0.0, uu = 0.0;  // u^T D^-1 g and u^T D^-1 u, with sqrt(n) folded in
+            for (int a = 0; a < ACTIONS; ++a) {
+                double d = n * p[a] + damping;
+                ug += p[a] * gs[a] / d;
+                uu += p[a] * p[a] / d;
+            }
+            double coef = n * ug / (1.0 - n * uu);
+            double* xs = x.row(s);
+            for (int a = 0; a < ACTIONS; ++a) {
+                xs[a] = (gs[a] + coef * p[a]) / (n * p[a] + damping);
+            }
+        }
+        return x;
+    }
+    
+    // Diagonal approximation over the taken actions only
+    TabularParams solve_diagonal(const BatchStats& stats, const TabularParams& g, double damping) {
+        TabularParams fisher_info = compute_fisher_info(stats);
+        TabularParams x(0.0);
+        for (int s : stats.states()) {
+            for (int a = 0; a < ACTIONS; ++a) {
+                if (fisher_info.row(s)[a] > 1e-8) {
+                    x.row(s)[a] = g.row(s)[a] / (fisher_info.row(s)[a] + damping);
                 }
             }
         }
+        return x;
     }
     
-    // Compute TRPO step size using line search
-    double compute_trpo_step_size(const std::vector<TRPOTrajectory>& trajectories,
-                                 const std::vector<std::vector<std::vector<double>>>& natural_gradients,
-                                 double max_kl) {
-        
-        double step_size = 1.0;
-        double alpha = 0.5;  // Backtracking factor
+    void update_policy_trpo(const BatchStats& stats, double max_kl = 0.01, double damping = 0.1) {
+        TabularParams gradients = compute_policy_gradient(stats);
         
-        // Line search to find appropriate step size
-        for (int i = 0; i < 10; ++i) {
-            // Compute KL divergence for current step size
-            double kl_div = compute_kl_divergence(trajectories, natural_gradients, step_size);
-            
-            if (kl_div <= max_kl) {
+        // Compute natural gradient using Fisher information matrix
+        TabularParams natural_gradients(0.0);
+        switch (solver) {
+            case NaturalGradientSolver::Diagonal:
+                natural_gradients = solve_diagonal(stats, gradients, damping);
                 break;
+            case NaturalGradientSolver::ConjugateGradient:
+                natural_gradients = solve_conjugate_gradient(stats, gradients, damping);
+                break;
+            case NaturalGradientSolver::BlockExact:
+                natural_gradients = solve_block_exact(stats, gradients, damping);
+                break;
+        }
+        
+        // With the true Fisher, scale the direction to the trust-region boundary:
+        // KL ~ 0.5 x^T F_mean x, so beta = sqrt(2 max_kl / x^T F_mean x)
+        if (solver != NaturalGradientSolver::Diagonal && stats.num_samples() > 0) {
+            TabularParams Fx(0.0);
+            fisher_vector_product(stats, natural_gradients, Fx, 0.0);
+            double xFx = 0.0;
+            for (int s : stats.states()) {
+                for (int a = 0; a < ACTIONS; ++a) xFx += natural_gradients.row(s)[a] * Fx.row(s)[a];
+            }
+            xFx /= stats.num_samples();
+            if (xFx > 1e-12) {
+                natural_gradients.scale(std::sqrt(2.0 * max_kl / xFx));
             }
-            
-            step_size *= alpha;
         }
         
-        return step_size;
+        // Compute step size using line search
+        double step_size = compute_trpo_step_size(stats, natural_gradients, max_kl);
+        
+        // Update parameters
+        theta.axpy(step_size, natural_gradients);
     }
     
-    // Compute KL divergence between old and new policy
-    double compute_kl_divergence(const std::vector<TRPOTrajectory>& trajectories,
-                                const std::vector<std::vector<std::vector<double>>>& natural_gradients,
-                                double step_size) {
+    // Batched backtracking line search. All candidate step sizes 1, 1/2, ..., 1/2^9 are
+    // evaluated in one pass over the distinct states. The work is split into items of one
+    // state block (LINE_SEARCH_BLOCK states) times one group of LINE_SEARCH_GROUP
+    // candidates, so even a batch with a single block yields several items for the worker
+    // pool; inside an item the candidates are laid out innermost so the per-action loops
+    // run across them. Every candidate's sums are accumulated in state order within a
+    // block and blocks are reduced in order, so the result does not depend on the thread
+    // count. Returns the largest step that keeps the sampled KL within max_kl and improves
+    // the importance-weighted surrogate, or 0 to reject.
+    double compute_trpo_step_size(const BatchStats& stats,
+                                 const TabularParams& natural_gradients,
+                                 double max_kl) {
+        constexpr int K = LINE_SEARCH_STEPS;
+        constexpr int G = LINE_SEARCH_GROUP;
+        constexpr size_t GROUPS = K / G;
+        std::array<double, K> steps;
+        steps[0] = 1.0;
+        for (int k = 1; k < K; ++k) steps[k] = steps[k - 1] * 0.5;  // Backtracking factor
         
-        double kl_div = 0.0;
-        int count = 0;
+        struct Partial {
+            std::array<double, K> kl{}, kl_count{}, gain{};
+        };
+        const std::vector<int>& states = stats.states();
+        size_t blocks = std::max<size_t>(1, (states.size() + LINE_SEARCH_BLOCK - 1) / LINE_SEARCH_BLOCK);
+        std::vector<Partial> partial(blocks);  // items of one block write disjoint candidate lanes
         
-        for (const auto& traj : trajectories) {
-            for (size_t t = 0; t < traj.states.size(); ++t) {
-                int r = traj.states[t].first;
-                int c = traj.states[t].second;
-                int action = traj.actions[t];
-                
-                // Old policy probability
-                double old_prob = traj.action_probs[t];
-                
-                // New policy probability (approximated)
-                std::vector<double> old_logits = theta[r][c];
-                std::vector<double> new_logits = old_logits;
-                for (int a = 0; a < ACTIONS; ++a) {
-                    new_logits[a] += step_size * natural_gradients[r][c][a];
-                }
-                
-                // Compute new probabilities
-                double max_logit = *std::max_element(new_logits.begin(), new_logits.end());
-                double sum_exp = 0.0;
-                std::vector<double> new_probs(ACTIONS);
-                for (int a = 0; a < ACTIONS; ++a) {
-                    new_probs[a] = std::exp(new_logits[a] - max_logit);
-                    sum_exp += new_probs[a];
-                }
-                for (int a = 0; a < ACTIONS; ++a) {
-                    new_probs[a] /= sum_exp;
-                }
-                
-                double new_prob = new_probs[action];
-                
-                // KL divergence
-                if (old_prob > 1e-8 && new_prob > 1e-8) {
-                    kl_div += old_prob * std::log(old_prob / new_prob);
-                    count++;
+        default_thread_pool().parallel_for(blocks * GROUPS, [&](size_t, size_t first, size_t last) {
+            for (size_t item = first; item < last; ++item) {
+                size_t blk = item / GROUPS;
+                const int k0 = static_cast<int>(item % GROUPS) * G;
+                Partial& out = partial[blk];
+                size_t end = std::min(states.size(), (blk + 1) * LINE_SEARCH_BLOCK);
+                for (size_t i = blk * LINE_SEARCH_BLOCK; i < end; ++i) {
+                    int s = states[i];
+                    const double* th = theta.row(s);
+                    const double* g = natural_gradients.row(s);
+                    
+                    // candidate probabilities q[a][j] of the new policy for step sizes k0 + j
+                    double q[ACTIONS][G], mx[G], inv_sum[G];
+                    for (int a = 0; a < ACTIONS; ++a)
+                        for (int j = 0; j < G; ++j) q[a][j] = th[a] + steps[k0 + j] * g[a];
+                    for (int j = 0; j < G; ++j) mx[j] = q[0][j];
+                    for (int a = 1; a < ACTIONS; ++a)
+                        for (int j = 0; j < G; ++j) mx[j] = std::max(mx[j], q[a][j]);
+                    for (int j = 0; j < G; ++j) inv_sum[j] = 0.0;
+                    for (int a = 0; a < ACTIONS; ++a)
+                        for (int j = 0; j < G; ++j) {
+                            q[a][j] = std::exp(q[a][j] - mx[j]);
+                            inv_sum[j] += q[a][j];
+                        }
+                    for (int j = 0; j < G; ++j) inv_sum[j] = 1.0 / inv_sum[j];
+                    
+                    for (int a = 0; a < ACTIONS; ++a) {
+                        const PairStats& e = stats.at(s, a);
+                        if (e.old_count == 0.0) continue;
+                        double inv_old = 1.0 / e.mean_old_prob();
+                        for (int j = 0; j < G; ++j) {
+                            double p = q[a][j] * inv_sum[j];
+                            out.gain[k0 + j] += e.sum_weight * (p * inv_old - 1.0);
+                            if (p > 1e-8) {
+                                out.kl[k0 + j] += e.sum_old_plogp - e.sum_old_prob * std::log(p);
+                                out.kl_count[k0 + j] += e.old_count;
+                            }
+                        }
+                    }
                 }
             }
+        });
+        
+        Partial total;
+        for (const Partial& part : partial) {
+            for (int k = 0; k < K; ++k) {
+                total.kl[k] += part.kl[k];
+                total.kl_count[k] += part.kl_count[k];
+                total.gain[k] += part.gain[k];
+            }
         }
         
-        return count > 0 ? kl_div / count : 0.0;
+        // largest step satisfying both conditions
+        for (int k = 0; k < K; ++k) {
+            double kl_div = total.kl_count[k] > 0 ? total.kl[k] / total.kl_count[k] : 0.0;
+            if (kl_div <= max_kl && total.gain[k] > 0.0) {
+                return steps[k];
+            }
+        }
+        return 0.0;
     }
     
     // Get optimal policy
@@ -229,53 +394,43 @@ public:
         std::vector<std::vector<int>> policy(ROWS, std::vector<int>(COLS));
         for (int r = 0; r < ROWS; ++r) {
             for (int c = 0; c < COLS; ++c) {
-                std::vector<double> probs = get_action_probs(r, c);
-                policy[r][c] = std::max_element(probs.begin(), probs.end()) - probs.begin();
+                policy[r][c] = theta.argmax(r, c);
             }
         }
         return policy;
     }
 };
 
-// Run episode and return trajectory
-TRPOTrajectory run_episode_trpo(const Grid& grid, TRPOPolicyNetwork& policy_net, int max_steps = 1000) {
-    TRPOTrajectory traj;
-    traj.total_return = 0.0;
+// Run episode, appending its steps and behaviour log-probabilities to the buffer
+// (RolloutBuffer or RunLengthBuffer); returns the discounted return
+template <typename Buffer>
+double run_episode_trpo(const Grid& grid, TRPOPolicyNetwork& policy_net, Buffer& buffer,
+                        Rng& rng, int max_steps = 1000) {
+    double total_return = 0.0;
     
     // Random starting state (avoid forbidden areas)
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<int> dist_r(0, ROWS - 1);
-    std::uniform_int_distribution<int> dist_c(0, COLS - 1);
-    
     int r, c;
     do {
-        r = dist_r(rng);
-        c = dist_c(rng);
+        r = rng.uniform_int(ROWS);
+        c = rng.uniform_int(COLS);
     } while (grid[r][c].type == StateType::Forbidden);
     
     double gamma_power = 1.0;  // gamma^t
     
     for (int step = 0; step < max_steps; ++step) {
-        // Record current state
-        traj.states.emplace_back(r, c);
-        
-        // Sample action
-        int action = policy_net.sample_action(r, c);
-        traj.actions.push_back(action);
-        
-        // Record action probability
-        double action_prob = policy_net.get_action_prob(r, c, action);
-        traj.action_probs.push_back(action_prob);
+        // Sample action and record its probability
+        double action_prob;
+        int action = policy_net.sample_action(r, c, rng, &action_prob);
         
         // Execute action
         auto [next_r, next_c] = next_state(r, c, static_cast<Action>(action), grid);
         
         // Get reward
         double reward = grid[next_r][next_c].reward;
-        traj.rewards.push_back(reward);
+        buffer.push(state_index(r, c), action, reward, std::log(action_prob));
         
         // Accumulate discounted return
-        traj.total_return += gamma_power * reward;
+        total_return += gamma_power * reward;
         gamma_power *= GAMMA;
         
         // Check if reached terminal state
@@ -292,6 +447,21 @@ TRPOTrajectory run_episode_trpo(const Grid& grid, TRPOPolicyNetwork& policy_net,
         c = next_c;
     }
     
+    buffer.end_episode(total_return);
+    return total_return;
+}
+
+// Run episode and return trajectory
+TRPOTrajectory run_episode_trpo(const Grid& grid, TRPOPolicyNetwork& policy_net, int max_steps = 1000) {
+    RolloutBuffer buffer;
+    TRPOTrajectory traj;
+    traj.total_return = run_episode_trpo(grid, policy_net, buffer, policy_net.generator(), max_steps);
+    for (size_t t = 0; t < buffer.num_steps(); ++t) {
+        traj.states.emplace_back(state_row(buffer.states[t]), state_col(buffer.states[t]));
+        traj.actions.push_back(buffer.actions[t]);
+        traj.rewards.push_back(buffer.rewards[t]);
+        traj.action_probs.push_back(std::exp(buffer.log_probs[t]));
+    }
     return traj;
 }
 
@@ -301,21 +471,24 @@ void trpo(const Grid& grid,
           std::vector<std::vector<int>>& policy,
           int num_episodes = 1000,
           int episodes_per_update = 20,
-          double max_kl = 0.01) {
+          double max_kl = 0.01,
+          uint64_t seed = DEFAULT_SEED) {
     
-    TRPOPolicyNetwork policy_net;
-    std::vector<TRPOTrajectory> trajectories;
+    TRPOPolicyNetwork policy_net(seed);
+    RngStreams streams(seed);  // One independent stream per episode for reproducible runs
+    RunLengthBuffer buffer;  // Reused across updates; capacity is kept by clear(); repeated steps are stored once
+    RolloutEngine<RunLengthBuffer> engine;  // Parallel collection; the batch does not depend on the thread count
     
-    for (int episode = 0; episode < num_episodes; ++episode) {
-        // Run episode
-        TRPOTrajectory traj = run_episode_trpo(grid, policy_net);
-        trajectories.push_back(traj);
+    // Update policy every episodes_per_update episodes (a trailing partial batch was never used, so it is not collected)
+    int num_updates = num_episodes / episodes_per_update;
+    for (int update = 0; update < num_updates; ++update) {
+        // Collect one batch in parallel; the policy is read-only meanwhile
+        policy_net.prepare_rollouts();
+        engine.collect(buffer, streams, static_cast<uint64_t>(update) * episodes_per_update, episodes_per_update,
+                       [&](RunLengthBuffer& out, Rng& rng) { run_episode_trpo(grid, policy_net, out, rng); });
         
-        // Update policy every few episodes
-        if ((episode + 1) % episodes_per_update == 0) {
-            policy_net.update_policy_trpo(trajectories, max_kl);
-            trajectories.clear();
-        }
+        policy_net.update_policy_trpo(buffer, max_kl);
+        buffer.clear();
     }
     
     // Get final optimal policy
@@ -331,7 +504,7 @@ void trpo(const Grid& grid,
                 V[r][c] = grid[r][c].reward;
             } else {
                 // Compute expected value for normal states
-                std::vector<double> probs = policy_net.get_action_probs(r, c);
+                ActionProbs probs = policy_net.get_action_probs(r, c);
                 for (int a = 0; a < ACTIONS; ++a) {
                     auto [next_r, next_c] = next_state(r, c, static_cast<Action>(a), grid);
                     V[r][c] += probs[a] * (grid[next_r][next_c].reward + GAMMA * V[next_r][next_c]);
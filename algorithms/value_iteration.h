@@ -8,6 +8,8 @@
 #include <vector>
 #include "../env/gridworld.h"
 #include "../env/mdp_config.h"
+#include "compact_tables.h"
+#include "../utils/thread_pool.h"
 /*
 算法思路:
 初始化状态值V（比如全设为0），定义一个策略并赋初值（赋予多少不重要，仅仅为定义变量赋初值）
@@ -48,7 +50,7 @@ void value_iteration(const Grid& grid,std::vector<std::vector<double>>& V,std::v
             int best_a = 0;
             for (int a = 0; a < ACTIONS; ++a) {
                 auto [next_r,next_c] = next_state(r,c,static_cast<Action>(a),grid);
-                double val = grid[r][c].reward + GAMMA * V[next_r][next_c];
+                double val = grid[next_r][next_c].reward + GAMMA * V[next_r][next_c];
                 if (val > best_q) {
                     best_q = val;
                     best_a = a;
@@ -60,4 +62,101 @@ void value_iteration(const Grid& grid,std::vector<std::vector<double>>& V,std::v
 
 }
 
+//并行版本：Jacobi迭代，每轮只读上一轮的V_old、写入新的V，各行之间没有数据依赖，可按行切块交给线程池
+//delta按固定的行块归约（pool.reduce），结果与线程数无关；收敛所需轮数比上面的原地(Gauss-Seidel)更新略多，但不动点相同
+void value_iteration(const Grid& grid,std::vector<std::vector<double>>& V,std::vector<std::vector<int>>& policy,
+                     ThreadPool& pool) {
+    V.assign(ROWS,std::vector<double>(COLS,0.0));
+    policy.assign(ROWS,std::vector<int>(COLS,-1));
+    std::vector<std::vector<double>> V_old = V;
+
+    while (1) {
+        V_old.swap(V);
+        //每个行块返回本块内的最大变化量
+        double delta = pool.reduce(ROWS,1,0.0,[&](size_t first,size_t last) {
+            double block_delta = 0.0;
+            for (int r = static_cast<int>(first); r < static_cast<int>(last); ++r) {
+                for (int c = 0; c < COLS; ++c) {
+                    double best_q = -1e9;
+                    for (int a = 0; a < ACTIONS; ++a) {
+                        auto [next_r,next_c] = next_state(r,c,static_cast<Action> (a),grid);
+                        double q_value = grid[next_r][next_c].reward + GAMMA * V_old[next_r][next_c];
+                        if (q_value > best_q) best_q = q_value;
+                    }
+                    block_delta = std::max(block_delta,std::fabs(best_q - V_old[r][c]));
+                    V[r][c] = best_q;
+                }
+            }
+            return block_delta;
+        },[](double x,double y) { return std::max(x,y); });
+        if (delta < THETA)  break;//收敛
+    }
+
+    //策略提取：与串行版本相同的一步前瞻，各状态互不依赖
+    pool.parallel_for(ROWS,[&](size_t,size_t first,size_t last) {
+        for (int r = static_cast<int>(first); r < static_cast<int>(last); ++r) {
+            for (int c = 0; c < COLS; ++c) {
+                double best_q = -1e9;
+                int best_a = 0;
+                for (int a = 0; a < ACTIONS; ++a) {
+                    auto [next_r,next_c] = next_state(r,c,static_cast<Action>(a),grid);
+                    double val = grid[next_r][next_c].reward + GAMMA * V[next_r][next_c];
+                    if (val > best_q) {
+                        best_q = val;
+                        best_a = a;
+                    }
+                }
+                policy[r][c] = best_a;
+            }
+        }
+    });
+}
+
+//紧凑存储版本：V以float32/16位定点存储，policy按3 bit打包，Acc为迭代中的累加精度
+//收敛判据使用实际写回存储的变化量，且不低于存储精度（否则量化后永远到不了THETA）
+template <typename Acc = double, typename Storage>
+void value_iteration(const Grid& grid,CompactValueTable<Storage>& V,PackedPolicy& policy) {
+    V.fill(0.0);
+
+    while (1) {
+        Acc delta = 0;
+        Acc max_abs = 0;
+        for (int r = 0; r < ROWS; ++r) {
+            for (int c = 0; c < COLS; ++c) {
+                Acc best_q = static_cast<Acc>(-1e9);
+                for (int a = 0; a < ACTIONS; ++a) {
+                    auto [next_r,next_c] = next_state(r,c,static_cast<Action> (a),grid);
+                    Acc q_value = static_cast<Acc>(grid[next_r][next_c].reward)
+                                + static_cast<Acc>(GAMMA) * static_cast<Acc>(V.get(next_r,next_c));
+                    if (q_value > best_q) best_q = q_value;
+                }
+                Acc old_v = static_cast<Acc>(V.get(r,c));
+                V.set(r,c,best_q);
+                delta = std::max(delta,std::fabs(static_cast<Acc>(V.get(r,c)) - old_v));
+                max_abs = std::max(max_abs,std::fabs(best_q));
+            }
+        }
+        Acc tol = std::max(static_cast<Acc>(THETA),static_cast<Acc>(V.resolution(max_abs)));
+        if (delta <= tol)  break;
+    }
+
+    //策略提取：与上面相同的一步前瞻，取argmax
+    for (int r = 0; r < ROWS; ++r) {
+        for (int c = 0; c < COLS; ++c) {
+            Acc best_q = static_cast<Acc>(-1e9);
+            int best_a = 0;
+            for (int a = 0; a < ACTIONS; ++a) {
+                auto [next_r,next_c] = next_state(r,c,static_cast<Action>(a),grid);
+                Acc val = static_cast<Acc>(grid[next_r][next_c].reward)
+                        + static_cast<Acc>(GAMMA) * static_cast<Acc>(V.get(next_r,next_c));
+                if (val > best_q) {
+                    best_q = val;
+                    best_a = a;
+                }
+            }
+            policy.set(r,c,best_a);
+        }
+    }
+}
+
 #endif //VALUE_ITERATION_H
@@ -8,6 +8,12 @@
 
 constexpr int ROWS = 5;
 constexpr int COLS = 5;
+constexpr int NUM_STATES = ROWS * COLS;//状态总数
+
+//(r,c)与线性状态编号之间的转换
+constexpr int state_index(int r,int c) { return r * COLS + c; }
+constexpr int state_row(int s) { return s / COLS; }
+constexpr int state_col(int s) { return s % COLS; }
 
 enum Action {UP = 0,RIGHT = 1,DOWN = 2,LEFT = 3,STAY = 4};
 constexpr int ACTIONS = 5;
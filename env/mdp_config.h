@@ -7,5 +7,6 @@
 
 constexpr double GAMMA = 0.9;//折扣因子
 constexpr double THETA = 1e-6;//收敛阈值 - 到达阈值后停止迭代
+constexpr int DEFAULT_TIME_LIMIT = 100;//回合步数上限 - 到达后截断回合并用价值估计自举(GAMMA^100约为3e-5，截断误差可忽略)
 
 #endif //MDP_CONFIG_H
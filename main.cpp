@@ -7,6 +7,8 @@
 #include "algorithms/trpo.h"
 #include "algorithms/ppo.h"
 #include "algorithms/ddpg.h"
+#include "algorithms/impala.h"
+#include "algorithms/hogwild.h"
 
 // Print grid representation of state values V
 void print_grid(const std::vector<std::vector<double>> V) {
@@ -39,6 +41,14 @@ void print_policy(const std::vector<std::vector<int>>& policy, const Grid& grid)
     std::cout << "\n";
 }
 
+// Print one line of training throughput and greedy-policy quality
+void print_report(const char* name, const HogwildReport& report) {
+    std::cout << std::setw(12) << name << ": " << report.threads << " thread(s), "
+              << std::setprecision(0) << report.episodes_per_second << " episodes/s, ";
+    if (report.steps_per_second > 0.0) std::cout << report.steps_per_second << " steps/s, ";
+    std::cout << std::setprecision(3) << "greedy return " << report.greedy_return << "\n";
+}
+
 int main() {
     Grid grid;
     build_grid(grid);
@@ -51,11 +61,23 @@ int main() {
     print_grid(V);
     print_policy(policy, grid);
 
+    std::cout << "--- Value Iteration (parallel Jacobi sweeps) ---\n";
+    value_iteration(grid, V, policy, default_thread_pool());
+    print_grid(V);
+    print_policy(policy, grid);
+
     std::cout << "--- Policy Iteration ---\n";
     policy_iteration(grid, V, policy);
     print_grid(V);
     print_policy(policy, grid);
 
+    std::cout << "--- Value Iteration (16-bit values, 3-bit policy) ---\n";
+    Quantized16ValueTable V_q = Quantized16ValueTable::for_grid(grid);
+    PackedPolicy packed_policy;
+    value_iteration(grid, V_q, packed_policy);
+    print_grid(V_q.to_dense());
+    print_policy(packed_policy.unpack(), grid);
+
     std::cout << "--- REINFORCE (Policy Gradient) ---\n";
     reinforce(grid, V, policy, 2000, 20, 0.01);  // 2000 episodes, update every 20 episodes, lr=0.01
     print_grid(V);
@@ -67,7 +89,7 @@ int main() {
     print_policy(policy, grid);
 
     std::cout << "--- PPO (Proximal Policy Optimization) ---\n";
-    ppo(grid, V, policy, 1500, 15, 0.001, 0.2);  // 1500 episodes, update every 15 episodes, lr=0.001, epsilon=0.2
+    ppo(grid, V, policy, 100, 15, 0.001, 0.2);  // 100 updates of 15 lockstep envs x 64 steps, lr=0.001, epsilon=0.2
     print_grid(V);
     print_policy(policy, grid);
 
@@ -76,5 +98,47 @@ int main() {
     print_grid(V);
     print_policy(policy, grid);
 
+    std::cout << "--- DDPG (per-step learning from a streamed episode) ---\n";
+    EpisodeLogger ddpg_log;
+    ddpg(grid, V, policy, 0, 32, 0.001, 0.001, 0.001, DEFAULT_SEED, ReplaySampling::Uniform,
+         TargetUpdate::Lazy, 1, &ddpg_log, DEFAULT_TIME_LIMIT, 100000);  // one update per step, 100k-step budget
+    print_grid(V);
+    print_policy(policy, grid);
+    std::cout << std::setprecision(2) << ddpg_log.num_episodes() << " episodes, mean length " << ddpg_log.mean_length()
+              << ", mean return " << ddpg_log.mean_return() << "\n\n";
+
+    std::cout << "--- Hogwild REINFORCE (lock-free shared table) ---\n";
+    HogwildReport sync_pg = time_training(grid, policy, 2000, static_cast<int>(default_thread_pool().size()),
+                                          [&] { reinforce(grid, V, policy, 2000, 20, 0.01); });
+    HogwildReport hog_pg = reinforce_hogwild(grid, V, policy, 2000, 0.01);  // 2000 episodes, lr=0.01
+    print_grid(V);
+    print_policy(policy, grid);
+    print_report("synchronous", sync_pg);
+    print_report("hogwild", hog_pg);
+    std::cout << "\n";
+
+    std::cout << "--- Hogwild DDPG critic (lock-free shared tables) ---\n";
+    HogwildReport sync_ac = time_training(grid, policy, 1500, 1, [&] {
+        EpisodeLogger steps_log;  // counts the environment steps for steps/s
+        ddpg(grid, V, policy, 1500, 32, 0.001, 0.001, 0.001, DEFAULT_SEED, ReplaySampling::Uniform,
+             TargetUpdate::Lazy, 0, &steps_log);
+        return steps_log.num_steps();
+    });
+    HogwildReport hog_ac = ddpg_hogwild(grid, V, policy, 1500, 0.001, 0.001);  // 1500 episodes, actor_lr=0.001, critic_lr=0.001
+    print_grid(V);
+    print_policy(policy, grid);
+    print_report("synchronous", sync_ac);
+    print_report("hogwild", hog_ac);
+    std::cout << "\n";
+
+    std::cout << "--- IMPALA (asynchronous actor-learner, V-trace) ---\n";
+    ImpalaStats impala_stats;
+    impala(grid, V, policy, 0, 15, 0.01, 0.1, 0, DEFAULT_SEED, &impala_stats,
+           DEFAULT_TIME_LIMIT, 20000);  // learner batch of 15 episodes, lr=0.01, value lr=0.1, 20k-step budget
+    print_grid(V);
+    print_policy(policy, grid);
+    std::cout << impala_stats.episodes << " episodes, " << impala_stats.env_steps << " steps, "
+              << impala_stats.updates << " updates, mean policy lag " << impala_stats.mean_policy_lag << "\n";
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+// Lazy C++20 coroutine sequence (what std::generator provides in C++23).
+// The coroutine body runs only when the consumer advances, up to its next co_yield, so
+// producer and consumer interleave step by step and nothing is buffered in between.
+// Values are yielded by reference: the element seen through the iterator lives in the
+// coroutine frame and is valid until the next increment. Single pass, move-only;
+// exceptions thrown in the body are rethrown to the consumer.
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        const T* current = nullptr;
+        std::exception_ptr error;
+
+        Generator get_return_object() {
+            return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        // A yielded temporary lives until the coroutine resumes, so pointing at it is safe
+        std::suspend_always yield_value(const T& value) noexcept {
+            current = std::addressof(value);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { error = std::current_exception(); }
+
+        // Generators only yield; they cannot co_await
+        template <typename U>
+        std::suspend_never await_transform(U&&) = delete;
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    struct sentinel {};
+
+    class iterator {
+    private:
+        handle_type coro;
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using reference = const T&;
+        using pointer = const T*;
+
+        iterator() = default;
+        explicit iterator(handle_type coro) : coro(coro) {}
+
+        iterator& operator++() {
+            coro.resume();
+            if (coro.done() && coro.promise().error) std::rethrow_exception(coro.promise().error);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        reference operator*() const { return *coro.promise().current; }
+        pointer operator->() const { return coro.promise().current; }
+
+        friend bool operator==(const iterator& it, sentinel) { return !it.coro || it.coro.done(); }
+    };
+
+private:
+    handle_type coro;
+
+    explicit Generator(handle_type coro) : coro(coro) {}
+
+public:
+    Generator(Generator&& o) noexcept : coro(std::exchange(o.coro, {})) {}
+    Generator& operator=(Generator&& o) noexcept {
+        if (this != &o) {
+            if (coro) coro.destroy();
+            coro = std::exchange(o.coro, {});
+        }
+        return *this;
+    }
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+    ~Generator() {
+        if (coro) coro.destroy();
+    }
+
+    // Starts the body; call once
+    iterator begin() {
+        iterator it(coro);
+        if (coro) ++it;
+        return it;
+    }
+    sentinel end() const { return {}; }
+};
+
+#endif //GENERATOR_H
@@ -0,0 +1,91 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+// Each cell carries a sequence number: equal to the enqueue position when the cell is
+// free for that producer, position + 1 once it holds a value for that consumer.
+// Producers and consumers each claim a position with one CAS and never wait on a lock;
+// try_push fails when the queue is full and try_pop when it is empty.
+template <typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+    static size_t round_up_pow2(size_t n) {
+        size_t p = 2;
+        while (p < n) p *= 2;
+        return p;
+    }
+
+public:
+    // Capacity is rounded up to a power of two (at least 2)
+    explicit BoundedQueue(size_t capacity) : cells(round_up_pow2(capacity)), mask(cells.size() - 1) {
+        for (size_t i = 0; i < cells.size(); ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool try_push(T value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& out) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t capacity() const { return cells.size(); }
+};
+
+#endif //MPMC_QUEUE_H
@@ -0,0 +1,104 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+constexpr uint64_t DEFAULT_SEED = 20250615;
+
+// SplitMix64 step; used to expand seeds into full generator states
+inline uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** (Blackman & Vigna): 32 bytes of state, a few cycles per draw.
+// Satisfies UniformRandomBitGenerator, so it also works with <random> distributions,
+// but the members below are used on hot paths because their output is identical on
+// every standard library.
+class Rng {
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    using result_type = uint64_t;
+
+    explicit Rng(uint64_t seed = DEFAULT_SEED) { reseed(seed); }
+
+    void reseed(uint64_t seed) {
+        for (auto& w : s) w = splitmix64(seed);
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+        const uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform double in [0, 1) with 53 random bits
+    double uniform01() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+    // Uniform integer in [0, n) (Lemire's multiply-shift, rejection removes the bias)
+    uint64_t uniform_index(uint64_t n) {
+        unsigned __int128 m = static_cast<unsigned __int128>((*this)()) * n;
+        uint64_t low = static_cast<uint64_t>(m);
+        if (low < n) {
+            const uint64_t threshold = (0 - n) % n;
+            while (low < threshold) {
+                m = static_cast<unsigned __int128>((*this)()) * n;
+                low = static_cast<uint64_t>(m);
+            }
+        }
+        return static_cast<uint64_t>(m >> 64);
+    }
+
+    int uniform_int(int n) { return static_cast<int>(uniform_index(static_cast<uint64_t>(n))); }
+};
+
+// Fisher-Yates shuffle; unlike std::shuffle the permutation is the same on every standard library
+template <typename T>
+void shuffle_in_place(std::vector<T>& v, Rng& rng) {
+    for (size_t i = v.size(); i > 1; --i) {
+        std::swap(v[i - 1], v[rng.uniform_index(i)]);
+    }
+}
+
+// Independent streams derived from one master seed. Stream k depends only on (seed, k),
+// so work keyed by a stable id (episode number, worker id) draws the same numbers no
+// matter which thread runs it or in what order.
+class RngStreams {
+private:
+    uint64_t master;
+
+public:
+    explicit RngStreams(uint64_t seed = DEFAULT_SEED) : master(seed) {}
+
+    Rng stream(uint64_t id) const {
+        uint64_t x = master ^ (id * 0xD1B54A32D192ED03ull);
+        return Rng(splitmix64(x));
+    }
+
+    uint64_t seed() const { return master; }
+};
+
+#endif //RNG_H
@@ -0,0 +1,159 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Versioned snapshots of a value with one writer and lock-free readers (RCU style,
+// reclaimed through hazard pointers).
+//
+// The writer fills back_buffer(), a private copy, and publish() swaps it in with one
+// atomic store. A reader pins the current version by announcing it in its own hazard
+// slot and re-checking that it is still current; the pinned version stays valid until
+// the Pin is destroyed, however many versions are published meanwhile. On every publish
+// the writer scans the hazard slots and recycles retired versions no reader holds as
+// future back buffers, so a steady state allocates nothing.
+//
+// Each concurrent reader needs its own slot id in [0, max_readers).
+template <typename T>
+class SnapshotPublisher {
+private:
+    struct Node {
+        T value;
+        uint64_t version = 0;
+    };
+
+    struct alignas(64) HazardSlot {
+        std::atomic<Node*> node{nullptr};
+    };
+
+    std::atomic<Node*> current;
+    std::atomic<uint64_t> latest{1};           // version of current, readable without a pin
+    mutable std::vector<HazardSlot> hazards;
+    std::vector<std::unique_ptr<Node>> nodes;  // every node ever allocated (owner)
+    std::vector<Node*> retired;                // replaced versions, possibly still pinned
+    std::vector<Node*> spare;                  // unpinned retired nodes, reused as back buffers
+    Node* back = nullptr;
+
+    Node* take_back_node() {
+        if (!back) {
+            if (spare.empty()) {
+                nodes.push_back(std::make_unique<Node>());
+                back = nodes.back().get();
+            } else {
+                back = spare.back();
+                spare.pop_back();
+            }
+        }
+        return back;
+    }
+
+    void reclaim() {
+        auto pinned = [this](Node* n) {
+            for (const HazardSlot& h : hazards) {
+                if (h.node.load(std::memory_order_seq_cst) == n) return true;
+            }
+            return false;
+        };
+        auto keep = std::partition(retired.begin(), retired.end(), pinned);
+        spare.insert(spare.end(), keep, retired.end());
+        retired.erase(keep, retired.end());
+    }
+
+public:
+    // Read handle on one version; releases the hazard slot on destruction
+    class Pin {
+    private:
+        std::atomic<Node*>* slot = nullptr;
+        const Node* node = nullptr;
+        friend class SnapshotPublisher;
+        Pin(std::atomic<Node*>* slot, const Node* node) : slot(slot), node(node) {}
+
+    public:
+        Pin() = default;
+        Pin(Pin&& o) noexcept : slot(o.slot), node(o.node) { o.slot = nullptr; o.node = nullptr; }
+        Pin& operator=(Pin&& o) noexcept {
+            if (this != &o) {
+                release();
+                slot = o.slot;
+                node = o.node;
+                o.slot = nullptr;
+                o.node = nullptr;
+            }
+            return *this;
+        }
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+        ~Pin() { release(); }
+
+        void release() {
+            if (slot) slot->store(nullptr, std::memory_order_release);
+            slot = nullptr;
+            node = nullptr;
+        }
+
+        explicit operator bool() const { return node != nullptr; }
+        const T& operator*() const { return node->value; }
+        const T* operator->() const { return &node->value; }
+        uint64_t version() const { return node->version; }
+    };
+
+    explicit SnapshotPublisher(const T& initial, size_t max_readers = 64) : hazards(max_readers) {
+        nodes.push_back(std::make_unique<Node>(Node{initial, 1}));
+        current.store(nodes.back().get(), std::memory_order_release);
+    }
+
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+    size_t max_readers() const { return hazards.size(); }
+
+    // Reader: pin the current version using hazard slot reader_slot
+    Pin pin(size_t reader_slot) const {
+        auto& slot = hazards[reader_slot].node;
+        Node* n = current.load(std::memory_order_acquire);
+        while (true) {
+            slot.store(n, std::memory_order_seq_cst);
+            Node* again = current.load(std::memory_order_seq_cst);
+            if (again == n) return Pin(&slot, n);
+            n = again;
+        }
+    }
+
+    // Version number of the latest publish (starts at 1)
+    uint64_t version() const { return latest.load(std::memory_order_acquire); }
+
+    // Writer: private buffer for the next version, initialised from the current one
+    T& back_buffer() {
+        if (!back) take_back_node()->value = current.load(std::memory_order_relaxed)->value;
+        return back->value;
+    }
+
+    // Writer: make the back buffer the current version
+    void publish() {
+        back_buffer();
+        Node* old = current.load(std::memory_order_relaxed);
+        back->version = old->version + 1;
+        current.store(back, std::memory_order_seq_cst);
+        latest.store(back->version, std::memory_order_release);
+        back = nullptr;
+        retired.push_back(old);
+        reclaim();
+    }
+
+    // Writer: replace the value and publish in one call
+    void publish(const T& value) {
+        take_back_node()->value = value;
+        publish();
+    }
+};
+
+#endif //SNAPSHOT_H
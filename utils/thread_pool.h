@@ -0,0 +1,288 @@
+//
+// Created by cuihs on 2025/6/15.
+//
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Counters of a ThreadPool since construction or the last reset_stats()
+struct ThreadPoolStats {
+    uint64_t tasks_executed = 0;  // queued tasks run by any thread (inline chunk 0 is not counted)
+    uint64_t tasks_stolen = 0;    // of those, tasks taken from another thread's queue
+    size_t max_queue_depth = 0;   // deepest any single queue has been
+};
+
+// Work-stealing scheduler shared by all solvers and trainers.
+// Every worker owns a deque: it pushes and pops its own work at the back (LIFO, cache
+// warm) and, when that runs dry, steals from the front of the others (FIFO, oldest and
+// usually largest work first). Threads outside the pool share queue 0. A thread that
+// waits for its tasks keeps executing queued work meanwhile, so nested parallel calls
+// cannot deadlock and a pool of size 1 still makes progress.
+class ThreadPool {
+private:
+    struct alignas(64) WorkQueue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<size_t> max_depth{0};
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;  // queues[0] is shared by outside threads
+    std::vector<std::thread> workers;                // worker i owns queues[i + 1]
+    std::atomic<size_t> queued{0};                   // tasks sitting in any queue
+    std::mutex sleep_mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    // Queue owned by the calling thread (0 for threads outside this pool)
+    size_t own_queue() const {
+        return current_pool() == this ? current_index() : 0;
+    }
+    static const ThreadPool*& current_pool() { thread_local const ThreadPool* pool = nullptr; return pool; }
+    static size_t& current_index() { thread_local size_t index = 0; return index; }
+
+    void push_many(size_t q, size_t count, const std::function<void(size_t)>& make) {
+        WorkQueue& wq = *queues[q];
+        {
+            std::lock_guard<std::mutex> lock(wq.mtx);
+            for (size_t i = 0; i < count; ++i) make(i);
+            size_t depth = wq.tasks.size();
+            if (depth > wq.max_depth.load(std::memory_order_relaxed)) wq.max_depth.store(depth, std::memory_order_relaxed);
+        }
+        queued.fetch_add(count, std::memory_order_release);
+        { std::lock_guard<std::mutex> lock(sleep_mtx); }  // no worker is between its check and its wait
+        if (count == 1) cv.notify_one(); else cv.notify_all();
+    }
+
+    // Own queue first (newest task), then steal the oldest task of another queue
+    bool try_run_one(size_t self) {
+        std::function<void()> task;
+        bool stolen = false;
+        {
+            WorkQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (size_t k = 1; !task && k < queues.size(); ++k) {
+            WorkQueue& victim = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                stolen = true;
+            }
+        }
+        if (!task) return false;
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        task();
+        WorkQueue& own = *queues[self];
+        own.executed.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) own.stolen.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void worker_loop(size_t index) {
+        current_pool() = this;
+        current_index() = index;
+        while (true) {
+            if (try_run_one(index)) continue;
+            std::unique_lock<std::mutex> lock(sleep_mtx);
+            cv.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping && queued.load(std::memory_order_acquire) == 0) return;
+        }
+    }
+
+    static void pin_to_cpu(std::thread& t, size_t cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu % CPU_SETSIZE, &set);
+        pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+        (void)t;
+        (void)cpu;
+#endif
+    }
+
+public:
+    // num_threads counts the calling thread, so n threads start n - 1 workers.
+    // pin_threads binds worker i to CPU i + 1 (modulo the CPU count; Linux only).
+    explicit ThreadPool(size_t num_threads = std::max(1u, std::thread::hardware_concurrency()),
+                        bool pin_threads = false) {
+        num_threads = std::max<size_t>(num_threads, 1);
+        for (size_t i = 0; i < num_threads; ++i) queues.push_back(std::make_unique<WorkQueue>());
+        size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 1; i < num_threads; ++i) {
+            workers.emplace_back([this, i] { worker_loop(i); });
+            if (pin_threads) pin_to_cpu(workers.back(), i % cpus);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    ThreadPoolStats stats() const {
+        ThreadPoolStats s;
+        for (const auto& q : queues) {
+            s.tasks_executed += q->executed.load(std::memory_order_relaxed);
+            s.tasks_stolen += q->stolen.load(std::memory_order_relaxed);
+            s.max_queue_depth = std::max(s.max_queue_depth, q->max_depth.load(std::memory_order_relaxed));
+        }
+        return s;
+    }
+
+    void reset_stats() {
+        for (auto& q : queues) {
+            q->executed.store(0, std::memory_order_relaxed);
+            q->stolen.store(0, std::memory_order_relaxed);
+            q->max_depth.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Queue one task; pair with a TaskGroup or another completion signal
+    void submit(std::function<void()> task) {
+        size_t self = own_queue();
+        push_many(self, 1, [&](size_t) { queues[self]->tasks.push_back(std::move(task)); });
+    }
+
+    // Execute one queued task if there is any (used by threads waiting on their work)
+    bool help_one() { return try_run_one(own_queue()); }
+
+    // Run f(chunk) for chunk in [0, num_chunks) and wait for all of them.
+    // Chunks 1.. are queued on the caller's deque (idle threads steal them); chunk 0 runs inline.
+    template <typename F>
+    void run_chunks(size_t num_chunks, F&& f) {
+        if (num_chunks == 0) return;
+        std::atomic<size_t> remaining{num_chunks};
+        size_t self = own_queue();
+        if (num_chunks > 1) {
+            std::deque<std::function<void()>>& tasks = queues[self]->tasks;
+            push_many(self, num_chunks - 1, [&](size_t i) {
+                size_t k = i + 1;
+                tasks.emplace_back([&f, &remaining, k] {
+                    f(k);
+                    remaining.fetch_sub(1, std::memory_order_release);
+                });
+            });
+        }
+        f(0);
+        remaining.fetch_sub(1, std::memory_order_release);
+        while (remaining.load(std::memory_order_acquire) != 0) {
+            if (!try_run_one(self)) std::this_thread::yield();
+        }
+    }
+
+    // Split [0, n) into one contiguous range per thread and run f(chunk, begin, end)
+    template <typename F>
+    void parallel_for(size_t n, F&& f) {
+        size_t chunks = std::min(n, size());
+        run_chunks(chunks, [&](size_t k) {
+            f(k, n * k / chunks, n * (k + 1) / chunks);
+        });
+    }
+
+    // Deterministic reduction over [0, n): map(begin, end) -> T on fixed blocks of `grain`
+    // indices, combined left to right in block order, so the result never depends on the
+    // thread count or on which thread ran which block.
+    template <typename T, typename Map, typename Combine>
+    T reduce(size_t n, size_t grain, T identity, Map&& map, Combine&& combine) {
+        grain = std::max<size_t>(grain, 1);
+        size_t blocks = (n + grain - 1) / grain;
+        if (blocks == 0) return identity;
+        std::vector<T> partial(blocks, identity);
+        parallel_for(blocks, [&](size_t, size_t first, size_t last) {
+            for (size_t b = first; b < last; ++b) {
+                partial[b] = map(b * grain, std::min(n, (b + 1) * grain));
+            }
+        });
+        T result = identity;
+        for (const T& p : partial) result = combine(result, p);
+        return result;
+    }
+};
+
+// Fork-join group: run() queues independent tasks, wait() executes queued work until
+// every task of the group has finished. The group must outlive its tasks (wait() before
+// destruction; the destructor waits as well).
+class TaskGroup {
+private:
+    ThreadPool& pool;
+    std::atomic<size_t> pending{0};
+
+public:
+    explicit TaskGroup(ThreadPool& pool) : pool(pool) {}
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename F>
+    void run(F&& f) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit([this, f = std::forward<F>(f)]() mutable {
+            f();
+            pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void wait() {
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (!pool.help_one()) std::this_thread::yield();
+        }
+    }
+};
+
+// Settings for the process-wide pool; only honoured before its first use
+struct ThreadPoolConfig {
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    bool pin_threads = false;
+};
+
+inline ThreadPoolConfig& default_thread_pool_config() {
+    static ThreadPoolConfig config;
+    return config;
+}
+
+// Process-wide pool; one scheduler avoids oversubscription when algorithms run back to back
+inline ThreadPool& default_thread_pool() {
+    static ThreadPool pool(default_thread_pool_config().num_threads, default_thread_pool_config().pin_threads);
+    return pool;
+}
+
+// Set the size (and CPU pinning) of the process-wide pool; call before anything uses it
+inline void configure_default_thread_pool(size_t num_threads, bool pin_threads = false) {
+    default_thread_pool_config() = ThreadPoolConfig{std::max<size_t>(num_threads, 1), pin_threads};
+}
+
+#endif //THREAD_POOL_H